@@ -2,45 +2,542 @@
 #include <string>
 #include <memory>
 #include <queue>
+#include <deque>
+#include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <bit>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Text as a sequence of pieces, each a range of one of two buffers: the original text, which
+// is never modified, and an append-only buffer that receives all inserted text. The pieces
+// are kept in a treap ordered by position, where every node knows the length of its subtree,
+// so finding a position, inserting and erasing touch O(log n) nodes and never move text.
+class PieceTable {
+public:
+    struct Piece {
+        bool added = false;
+        size_t start = 0;
+        size_t length = 0;
+    };
+
+private:
+    struct Node {
+        Piece piece;
+        size_t subtreeLength = 0;
+        uint32_t priority = 0;
+        std::unique_ptr<Node> left;
+        std::unique_ptr<Node> right;
+    };
+
+    using NodePtr = std::unique_ptr<Node>;
+
+    std::string m_original;
+    std::string m_added;
+    NodePtr m_root;
+    uint32_t m_seed = 0x9E3779B9u;
+
+public:
+    PieceTable() = default;
+
+    explicit PieceTable(std::string text)
+        : m_original(std::move(text))
+    {
+        if (!m_original.empty()) {
+            m_root = makeNode({false, 0, m_original.size()});
+        }
+    }
+
+    size_t size() const {
+        return length(m_root);
+    }
+
+    // Returns where `str` went in the append-only buffer.
+    Piece insert(size_t pos, const std::string& str) {
+        if (str.empty()) {
+            return {};
+        }
+        auto [left, right] = split(std::move(m_root), pos);
+        // Typing appends to the piece that was added last; extend it instead of adding another.
+        bool extended = false;
+        if (left) {
+            Node* last = left.get();
+            while (last->right) {
+                last = last->right.get();
+            }
+            if (last->piece.added && last->piece.start + last->piece.length == m_added.size()) {
+                extendLast(left.get(), str.size());
+                extended = true;
+            }
+        }
+        size_t start = m_added.size();
+        m_added += str;
+        Piece piece{true, start, str.size()};
+        if (!extended) {
+            left = merge(std::move(left), makeNode(piece));
+        }
+        m_root = merge(std::move(left), std::move(right));
+        return piece;
+    }
+
+    // Puts back pieces taken out by erase(); both buffers only grow, so they stay valid.
+    void insertPieces(size_t pos, const Piece* pieces, size_t count) {
+        auto [left, right] = split(std::move(m_root), pos);
+        for (size_t i = 0; i < count; ++i) {
+            left = merge(std::move(left), makeNode(pieces[i]));
+        }
+        m_root = merge(std::move(left), std::move(right));
+    }
+
+    // Appends the erased pieces, in order, to `removed` if given.
+    void erase(size_t pos, size_t count, std::vector<Piece>* removed = nullptr) {
+        auto [left, rest] = split(std::move(m_root), pos);
+        auto [erased, right] = split(std::move(rest), count);
+        if (removed) {
+            collect(erased.get(), *removed);
+        }
+        m_root = merge(std::move(left), std::move(right));
+    }
+
+    // Appends the text in order to `out`.
+    void appendTo(std::string& out) const {
+        out.reserve(out.size() + size());
+        appendTo(m_root.get(), out);
+    }
+
+private:
+    static size_t length(const NodePtr& n) {
+        return n ? n->subtreeLength : 0;
+    }
+
+    static void update(Node& n) {
+        n.subtreeLength = length(n.left) + n.piece.length + length(n.right);
+    }
+
+    NodePtr makeNode(const Piece& piece) {
+        // xorshift32: enough randomness to keep the treap balanced.
+        m_seed ^= m_seed << 13;
+        m_seed ^= m_seed >> 17;
+        m_seed ^= m_seed << 5;
+        auto n = std::make_unique<Node>();
+        n->piece = piece;
+        n->priority = m_seed;
+        update(*n);
+        return n;
+    }
+
+    // The first `pos` bytes go left, the rest right; a piece that straddles `pos` is cut in two.
+    static std::pair<NodePtr, NodePtr> split(NodePtr t, size_t pos) {
+        if (!t) {
+            return {};
+        }
+        size_t leftLength = length(t->left);
+        if (pos <= leftLength) {
+            auto [a, b] = split(std::move(t->left), pos);
+            t->left = std::move(b);
+            update(*t);
+            return {std::move(a), std::move(t)};
+        }
+        if (pos >= leftLength + t->piece.length) {
+            auto [a, b] = split(std::move(t->right), pos - leftLength - t->piece.length);
+            t->right = std::move(a);
+            update(*t);
+            return {std::move(t), std::move(b)};
+        }
+
+        // The tail of the piece takes over the right subtree with the same priority, which
+        // keeps the heap order.
+        size_t offset = pos - leftLength;
+        auto tail = std::make_unique<Node>();
+        tail->piece = {t->piece.added, t->piece.start + offset, t->piece.length - offset};
+        tail->priority = t->priority;
+        tail->right = std::move(t->right);
+        update(*tail);
+        t->piece.length = offset;
+        update(*t);
+        return {std::move(t), std::move(tail)};
+    }
+
+    static NodePtr merge(NodePtr a, NodePtr b) {
+        if (!a) {
+            return b;
+        }
+        if (!b) {
+            return a;
+        }
+        if (a->priority >= b->priority) {
+            a->right = merge(std::move(a->right), std::move(b));
+            update(*a);
+            return a;
+        }
+        b->left = merge(std::move(a), std::move(b->left));
+        update(*b);
+        return b;
+    }
+
+    static void extendLast(Node* n, size_t count) {
+        for (; n; n = n->right.get()) {
+            n->subtreeLength += count;
+            if (!n->right) {
+                n->piece.length += count;
+            }
+        }
+    }
+
+    static void collect(const Node* n, std::vector<Piece>& out) {
+        while (n) {
+            collect(n->left.get(), out);
+            out.push_back(n->piece);
+            n = n->right.get();
+        }
+    }
+
+    void appendTo(const Node* n, std::string& out) const {
+        while (n) {
+            appendTo(n->left.get(), out);
+            const std::string& buffer = n->piece.added ? m_added : m_original;
+            out.append(buffer, n->piece.start, n->piece.length);
+            n = n->right.get();
+        }
+    }
+};
+
+// Edits go to a piece table, so they cost O(log n) however large the document is. text()
+// assembles the contiguous string on first use and keeps it until the next edit.
+//
+// Every edit is journaled as its inverse for undo() and redo(). The journal holds no text:
+// what an edit erased is kept as the pieces it removed, which still point into the piece
+// table's buffers, and what it inserted as its range of the append-only buffer. An entry
+// costs a few dozen bytes however much text it touched.
 class Document {
-    std::string m_content;
+    using Piece = PieceTable::Piece;
+
+    struct Edit {
+        uint64_t id = 0;
+        size_t pos = 0;
+        size_t erasedFirst = 0;  // in m_erased
+        size_t erasedCount = 0;
+        size_t erasedLength = 0;
+        Piece inserted;
+    };
+
+    PieceTable m_pieces;
+    mutable std::string m_text;
+    mutable bool m_textValid = false;
+
+    std::vector<Edit> m_journal;
+    std::vector<Piece> m_erased;
+    size_t m_applied = 0;  // m_journal[m_applied..] can be redone
+    uint64_t m_nextEdit = 1;
 
 public:
     Document() = default;
 
     Document(const std::string& text)
-        : m_content(text)
+        : m_pieces(text)
     {
     }
 
-    void insert(size_t pos, const std::string& str) {
-        if (pos > m_content.size()) {
-            pos = m_content.size();
+    size_t size() const {
+        return m_pieces.size();
+    }
+
+    // The edit functions return the id of the journal entry they made, 0 if nothing changed.
+    uint64_t insert(size_t pos, const std::string& str) {
+        if (pos > size()) {
+            pos = size();
         }
-        m_content.insert(pos, str);
+        return replaceRange(pos, 0, str);
     }
 
-    void erase(size_t pos, size_t count) {
-        if (pos > m_content.size()) {
-            return;
+    uint64_t erase(size_t pos, size_t count) {
+        if (pos > size()) {
+            return 0;
         }
-        m_content.erase(pos, count);
+        return replaceRange(pos, count, {});
     }
 
-    void replace(size_t pos, size_t count, const std::string& str) {
-        if (pos > m_content.size()) {
-            return;
+    uint64_t replace(size_t pos, size_t count, const std::string& str) {
+        if (pos > size()) {
+            return 0;
+        }
+        return replaceRange(pos, count, str);
+    }
+
+    bool undo() {
+        if (m_applied == 0) {
+            return false;
+        }
+        const Edit& e = m_journal[--m_applied];
+        m_pieces.erase(e.pos, e.inserted.length);
+        m_pieces.insertPieces(e.pos, m_erased.data() + e.erasedFirst, e.erasedCount);
+        m_textValid = false;
+        return true;
+    }
+
+    bool redo() {
+        if (m_applied == m_journal.size()) {
+            return false;
         }
-        m_content.replace(pos, count, str);
+        const Edit& e = m_journal[m_applied++];
+        m_pieces.erase(e.pos, e.erasedLength);
+        m_pieces.insertPieces(e.pos, &e.inserted, e.inserted.length > 0 ? 1 : 0);
+        m_textValid = false;
+        return true;
+    }
+
+    // The edit undo() would revert and the one redo() would reapply; 0 if there is none.
+    uint64_t lastEdit() const {
+        return m_applied > 0 ? m_journal[m_applied - 1].id : 0;
+    }
+
+    uint64_t nextRedo() const {
+        return m_applied < m_journal.size() ? m_journal[m_applied].id : 0;
     }
 
     const std::string& text() const {
-        return m_content;
+        if (!m_textValid) {
+            m_text.clear();
+            m_pieces.appendTo(m_text);
+            m_textValid = true;
+        }
+        return m_text;
     }
 
     const std::string& getText() const {
-        return m_content;
+        return text();
+    }
+
+private:
+    uint64_t replaceRange(size_t pos, size_t count, const std::string& str) {
+        count = std::min(count, size() - pos);
+        if (count == 0 && str.empty()) {
+            return 0;
+        }
+
+        // A new edit drops whatever could have been redone.
+        if (m_applied < m_journal.size()) {
+            m_erased.resize(m_journal[m_applied].erasedFirst);
+            m_journal.resize(m_applied);
+        }
+
+        Edit e;
+        e.id = m_nextEdit++;
+        e.pos = pos;
+        e.erasedFirst = m_erased.size();
+        e.erasedLength = count;
+        if (count > 0) {
+            m_pieces.erase(pos, count, &m_erased);
+        }
+        e.erasedCount = m_erased.size() - e.erasedFirst;
+        e.inserted = m_pieces.insert(pos, str);
+        m_journal.push_back(e);
+        m_applied = m_journal.size();
+        m_textValid = false;
+        return e.id;
+    }
+};
+
+// A set of replacement rules compiled into an Aho-Corasick automaton, so that finding every
+// occurrence of any of them is one pass over the text however many rules there are.
+//
+// Matches do not overlap: at each point the one that starts first wins, among those the
+// longest, and among equal patterns the rule listed first. Scanning resumes after a match,
+// so replacement text is never matched again. Rules with an empty pattern are ignored.
+//
+// Transitions are a dense table over byte classes, one class per byte that occurs in some
+// pattern and one for all others. Between matches the scan jumps straight to the next byte
+// that can start a pattern: memchr for one such byte, 16 bytes at a time with SSE2 for up to
+// four, a table lookup otherwise.
+class MultiReplacer {
+public:
+    struct Match {
+        size_t pos = 0;
+        size_t length = 0;
+        size_t rule = 0;
+    };
+
+    explicit MultiReplacer(std::vector<std::pair<std::string, std::string>> rules)
+        : m_rules(std::move(rules))
+    {
+        build();
+    }
+
+    bool empty() const {
+        return m_firstBytes.empty();
+    }
+
+    const std::string& replacement(size_t rule) const {
+        return m_rules[rule].second;
+    }
+
+    // Appends the matches in `text` to `out`, in order.
+    void findAll(std::string_view text, std::vector<Match>& out) const {
+        if (empty()) {
+            return;
+        }
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+        const size_t n = text.size();
+
+        uint32_t state = 0;
+        bool found = false;
+        Match best;
+        size_t i = 0;
+        for (;;) {
+            if (state == 0) {
+                i = skipToFirstByte(data, i, n);
+            }
+            if (i < n) {
+                state = m_next[size_t(state) * m_classCount + m_class[data[i]]];
+                ++i;
+
+                uint32_t rule = m_output[state];
+                if (rule != kNone) {
+                    size_t length = m_rules[rule].first.size();
+                    size_t pos = i - length;
+                    if (!found || pos < best.pos || (pos == best.pos && length > best.length)) {
+                        best = { pos, length, rule };
+                        found = true;
+                    }
+                }
+            } else if (!found) {
+                return;
+            }
+            // Once nothing still in progress can start at or before the best match, or the
+            // text ends, take it and go on from its end.
+            if (found && (i == n || i - m_depth[state] > best.pos)) {
+                out.push_back(best);
+                found = false;
+                i = best.pos + best.length;
+                state = 0;
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    std::vector<std::pair<std::string, std::string>> m_rules;
+
+    uint16_t m_class[256] = {};
+    size_t m_classCount = 1;
+    std::vector<uint32_t> m_next;    // state * m_classCount + class
+    std::vector<uint32_t> m_depth;
+    std::vector<uint32_t> m_output;  // rule of the longest pattern ending in the state
+    std::vector<unsigned char> m_firstBytes;
+    bool m_isFirst[256] = {};
+
+    void build() {
+        for (const auto& rule : m_rules) {
+            for (char c : rule.first) {
+                unsigned char b = static_cast<unsigned char>(c);
+                if (m_class[b] == 0) {
+                    m_class[b] = static_cast<uint16_t>(m_classCount++);
+                }
+            }
+            if (!rule.first.empty()) {
+                unsigned char b = static_cast<unsigned char>(rule.first[0]);
+                if (!m_isFirst[b]) {
+                    m_isFirst[b] = true;
+                    m_firstBytes.push_back(b);
+                }
+            }
+        }
+
+        // The trie, with missing transitions as kNone.
+        m_next.assign(m_classCount, kNone);
+        m_depth.assign(1, 0);
+        m_output.assign(1, kNone);
+        for (size_t r = 0; r < m_rules.size(); ++r) {
+            const std::string& pattern = m_rules[r].first;
+            if (pattern.empty()) {
+                continue;
+            }
+            uint32_t state = 0;
+            for (char c : pattern) {
+                uint32_t& next = m_next[size_t(state) * m_classCount + m_class[static_cast<unsigned char>(c)]];
+                if (next == kNone) {
+                    next = static_cast<uint32_t>(m_depth.size());
+                    m_depth.push_back(m_depth[state] + 1);
+                    m_output.push_back(kNone);
+                    m_next.resize(m_next.size() + m_classCount, kNone);
+                }
+                state = m_next[size_t(state) * m_classCount + m_class[static_cast<unsigned char>(c)]];
+            }
+            if (m_output[state] == kNone) {
+                m_output[state] = static_cast<uint32_t>(r);
+            }
+        }
+
+        // Breadth first, each state's missing transitions and output are taken from its
+        // failure state, which is shallower and so already complete.
+        std::vector<uint32_t> fail(m_depth.size(), 0);
+        std::vector<uint32_t> queue;
+        for (size_t c = 0; c < m_classCount; ++c) {
+            uint32_t& next = m_next[c];
+            if (next == kNone) {
+                next = 0;
+            } else {
+                queue.push_back(next);
+            }
+        }
+        for (size_t head = 0; head < queue.size(); ++head) {
+            uint32_t state = queue[head];
+            if (m_output[state] == kNone) {
+                m_output[state] = m_output[fail[state]];
+            }
+            for (size_t c = 0; c < m_classCount; ++c) {
+                uint32_t& next = m_next[size_t(state) * m_classCount + c];
+                uint32_t viaFail = m_next[size_t(fail[state]) * m_classCount + c];
+                if (next == kNone) {
+                    next = viaFail;
+                } else {
+                    fail[next] = viaFail;
+                    queue.push_back(next);
+                }
+            }
+        }
+    }
+
+    size_t skipToFirstByte(const unsigned char* data, size_t i, size_t n) const {
+        if (m_firstBytes.size() == 1) {
+            const void* hit = std::memchr(data + i, m_firstBytes[0], n - i);
+            return hit ? static_cast<const unsigned char*>(hit) - data : n;
+        }
+#if defined(__SSE2__) || defined(_M_X64)
+        if (m_firstBytes.size() <= 4) {
+            __m128i needles[4];
+            for (size_t k = 0; k < 4; ++k) {
+                needles[k] = _mm_set1_epi8(static_cast<char>(m_firstBytes[std::min(k, m_firstBytes.size() - 1)]));
+            }
+            for (; i + 16 <= n; i += 16) {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+                __m128i hits = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(block, needles[0]), _mm_cmpeq_epi8(block, needles[1])),
+                    _mm_or_si128(_mm_cmpeq_epi8(block, needles[2]), _mm_cmpeq_epi8(block, needles[3])));
+                unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+                if (mask != 0) {
+                    return i + std::countr_zero(mask);
+                }
+            }
+        }
+#endif
+        while (i < n && !m_isFirst[data[i]]) {
+            ++i;
+        }
+        return i;
     }
 };
 
@@ -48,12 +545,43 @@ class Command {
 public:
     virtual ~Command() = default;
     virtual void execute() = 0;
+
+    // The document this command edits. Commands on the same document always run in the order
+    // they were scheduled; an empty target groups the command with all other untargeted ones.
+    virtual std::weak_ptr<Document> target() const {
+        return {};
+    }
+
+    // Reverts the command's edit while it is still the latest one on its document, and
+    // reapplies it while it is the next one to redo. False if that is not the case.
+    virtual bool undo() {
+        return false;
+    }
+
+    virtual bool redo() {
+        return false;
+    }
+
+    // A plain insert (count 0) or erase (text null) at pos, in the form the scheduler uses to
+    // merge neighbouring edits. `edit` receives the journal id when the scheduler applies the
+    // command on its own; commands merged with others get no id and cannot undo() themselves.
+    struct EditOp {
+        size_t pos = 0;
+        size_t count = 0;
+        const std::string* text = nullptr;
+        uint64_t* edit = nullptr;
+    };
+
+    virtual bool editOp(EditOp&) {
+        return false;
+    }
 };
 
 class InsertTextCommand : public Command {
     std::weak_ptr<Document> m_doc;
     std::string m_text;
     size_t m_position;
+    uint64_t m_edit = 0;
 
 public:
     InsertTextCommand(std::shared_ptr<Document> doc,
@@ -63,13 +591,35 @@ public:
     {
     }
 
+    std::weak_ptr<Document> target() const override {
+        return m_doc;
+    }
+
     void execute() override {
         std::shared_ptr<Document> doc = m_doc.lock();
         if (!doc) {
             std::cout << "Document no longer exists. Skipping.\n";
             return;
         }
-        doc->insert(m_position, m_text);
+        m_edit = doc->insert(m_position, m_text);
+    }
+
+    bool editOp(EditOp& op) override {
+        op.pos = m_position;
+        op.count = 0;
+        op.text = &m_text;
+        op.edit = &m_edit;
+        return true;
+    }
+
+    bool undo() override {
+        std::shared_ptr<Document> doc = m_doc.lock();
+        return doc && m_edit != 0 && doc->lastEdit() == m_edit && doc->undo();
+    }
+
+    bool redo() override {
+        std::shared_ptr<Document> doc = m_doc.lock();
+        return doc && m_edit != 0 && doc->nextRedo() == m_edit && doc->redo();
     }
 };
 
@@ -77,6 +627,7 @@ class EraseTextCommand : public Command {
     std::weak_ptr<Document> m_doc;
     size_t m_position;
     size_t m_count;
+    uint64_t m_edit = 0;
 
 public:
     EraseTextCommand(std::shared_ptr<Document> doc,
@@ -86,13 +637,35 @@ public:
     {
     }
 
+    std::weak_ptr<Document> target() const override {
+        return m_doc;
+    }
+
     void execute() override {
         std::shared_ptr<Document> doc = m_doc.lock();
         if (!doc) {
             std::cout << "Document no longer exists. Skipping.\n";
             return;
         }
-        doc->erase(m_position, m_count);
+        m_edit = doc->erase(m_position, m_count);
+    }
+
+    bool editOp(EditOp& op) override {
+        op.pos = m_position;
+        op.count = m_count;
+        op.text = nullptr;
+        op.edit = &m_edit;
+        return true;
+    }
+
+    bool undo() override {
+        std::shared_ptr<Document> doc = m_doc.lock();
+        return doc && m_edit != 0 && doc->lastEdit() == m_edit && doc->undo();
+    }
+
+    bool redo() override {
+        std::shared_ptr<Document> doc = m_doc.lock();
+        return doc && m_edit != 0 && doc->nextRedo() == m_edit && doc->redo();
     }
 };
 
@@ -100,6 +673,8 @@ class ReplaceTextCommand : public Command {
     std::weak_ptr<Document> m_doc;
     std::string m_oldText;
     std::string m_newText;
+    std::shared_ptr<const MultiReplacer> m_rules;
+    uint64_t m_edit = 0;
 
 public:
     ReplaceTextCommand(std::shared_ptr<Document> doc,
@@ -111,42 +686,590 @@ public:
     {
     }
 
+    // Replaces every match of the rules, in one pass and as one edit. The rules can be shared
+    // by any number of commands.
+    ReplaceTextCommand(std::shared_ptr<Document> doc,
+        std::shared_ptr<const MultiReplacer> rules)
+        : m_doc(doc),
+        m_rules(std::move(rules))
+    {
+    }
+
+    std::weak_ptr<Document> target() const override {
+        return m_doc;
+    }
+
     void execute() override {
         std::shared_ptr<Document> doc = m_doc.lock();
         if (!doc) {
             std::cout << "Document no longer exists. Skipping.\n";
             return;
         }
+        if (m_rules) {
+            replaceAll(*doc);
+            return;
+        }
         const std::string& content = doc->text();
         size_t pos = content.find(m_oldText);
         if (pos == std::string::npos) {
             std::cout << "Substring not found. Skipping replace.\n";
             return;
         }
-        doc->replace(pos, m_oldText.size(), m_newText);
+        m_edit = doc->replace(pos, m_oldText.size(), m_newText);
+    }
+
+    bool undo() override {
+        std::shared_ptr<Document> doc = m_doc.lock();
+        return doc && m_edit != 0 && doc->lastEdit() == m_edit && doc->undo();
+    }
+
+    bool redo() override {
+        std::shared_ptr<Document> doc = m_doc.lock();
+        return doc && m_edit != 0 && doc->nextRedo() == m_edit && doc->redo();
+    }
+
+private:
+    void replaceAll(Document& doc) {
+        const std::string& content = doc.text();
+        std::vector<MultiReplacer::Match> matches;
+        m_rules->findAll(content, matches);
+        if (matches.empty()) {
+            std::cout << "No rule matched. Skipping replace.\n";
+            return;
+        }
+
+        // Only the span from the first match to the end of the last one is rewritten.
+        size_t first = matches.front().pos;
+        size_t last = matches.back().pos + matches.back().length;
+        std::string rewritten;
+        rewritten.reserve(last - first);
+        size_t at = first;
+        for (const MultiReplacer::Match& m : matches) {
+            rewritten.append(content, at, m.pos - at);
+            rewritten += m_rules->replacement(m.rule);
+            at = m.pos + m.length;
+        }
+        m_edit = doc.replace(first, last - first, rewritten);
     }
 };
 
+// A fixed-size ring that any number of threads can push to and pop from without locking
+// (D. Vyukov's bounded MPMC queue). Every cell carries a sequence number that tells whether
+// it is free for the push of a given lap or full for its pop, so a producer and a consumer
+// only contend on a cell when the ring is empty or full; a slot is claimed by one
+// compare-exchange on the tail or head. The ring is allocated by the first push.
+template <typename T>
+class BoundedQueue {
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::atomic<Cell*> m_cells{ nullptr };
+    size_t m_mask;
+    alignas(64) std::atomic<size_t> m_tail{ 0 };
+    alignas(64) std::atomic<size_t> m_head{ 0 };
+
+public:
+    // The capacity is rounded up to a power of two.
+    explicit BoundedQueue(size_t capacity)
+        : m_mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1)
+    {
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    ~BoundedQueue() {
+        delete[] m_cells.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const {
+        return m_mask + 1;
+    }
+
+    // Moves from `value` only if there was room.
+    bool tryPush(T& value) {
+        Cell* cells = m_cells.load(std::memory_order_acquire);
+        if (!cells) {
+            cells = allocate();
+        }
+        Cell* cell;
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells[pos & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& out) {
+        Cell* cells = m_cells.load(std::memory_order_acquire);
+        if (!cells) {
+            return false;
+        }
+        Cell* cell;
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells[pos & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+        out = std::move(cell->value);
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // Producers racing to allocate keep whichever ring was published first.
+    Cell* allocate() {
+        std::unique_ptr<Cell[]> fresh(new Cell[m_mask + 1]);
+        for (size_t i = 0; i <= m_mask; ++i) {
+            fresh[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        Cell* expected = nullptr;
+        if (m_cells.compare_exchange_strong(expected, fresh.get(), std::memory_order_acq_rel,
+                std::memory_order_acquire)) {
+            return fresh.release();
+        }
+        return expected;
+    }
+};
+
+// Runs scheduled commands when runAll() is called. By default they run one after another on
+// the calling thread. With a worker pool, runAll() groups the pending commands by target
+// document and hands each group to a worker: one document's commands keep their FIFO order,
+// different documents are edited in parallel, and runAll() returns once all of them are done.
+//
+// Consecutive commands on one document are run against a single lock() of it. Unless
+// coalescing is turned off, runs of inserts and erases are first merged into as few
+// replacements as cover them: adjacent inserts become one, an erase of freshly inserted
+// text cancels it. The final text is the same as running the commands one by one, but each
+// merged run is journaled as one edit, so it is reverted with Document::undo() rather than
+// through the commands.
+//
+// Any number of threads may schedule() at once, also while runAll() runs. Pending commands
+// wait in a bounded lock-free queue of 64K commands by default. When it is full, schedule()
+// waits for a running runAll() to make room, or if there is none, runs the pending commands
+// itself, so scheduling any number of commands before runAll() still works. Commands that
+// schedule more while the queue is full, and so cannot wait for it, go to an unbounded
+// overflow list that is run after the queue.
 class CommandScheduler {
-    std::queue<std::unique_ptr<Command>> m_pending;
+    using Batch = std::vector<std::unique_ptr<Command>>;
+
+    // Merged runs are flushed once their text reaches this size, as every insert into the
+    // middle of it moves the rest.
+    static constexpr size_t kMaxMergedText = 64 * 1024;
+
+    static constexpr size_t kDefaultCapacity = 64 * 1024;
+
+    BoundedQueue<std::unique_ptr<Command>> m_pending{ kDefaultCapacity };
+    std::mutex m_running;  // held by whoever drains m_pending
+    std::atomic<std::thread::id> m_runner;  // the thread holding m_running
+    std::mutex m_overflowMutex;
+    std::deque<std::unique_ptr<Command>> m_overflow;
+    bool m_coalesce = true;
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_workReady;
+    std::condition_variable m_batchDone;
+    std::vector<Batch> m_batches;
+    size_t m_nextBatch = 0;
+    size_t m_unfinished = 0;
+    bool m_stop = false;
 
 public:
+    CommandScheduler() = default;
+
+    // A pool of `threads` workers; 0 uses one per hardware thread. `capacity` bounds the
+    // number of pending commands.
+    explicit CommandScheduler(unsigned threads, size_t capacity = kDefaultCapacity)
+        : m_pending(capacity)
+    {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (unsigned i = 0; i < threads; ++i) {
+            m_workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    CommandScheduler(const CommandScheduler&) = delete;
+    CommandScheduler& operator=(const CommandScheduler&) = delete;
+
+    ~CommandScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_workReady.notify_all();
+        for (std::thread& t : m_workers) {
+            t.join();
+        }
+    }
+
     void schedule(std::unique_ptr<Command> cmd) {
-        m_pending.push(std::move(cmd));
+        if (isExecuting()) {
+            // Waiting here would wait for this very thread. Once anything overflowed, the
+            // rest follows it, so this thread's commands keep their order.
+            std::lock_guard<std::mutex> lock(m_overflowMutex);
+            if (!m_overflow.empty() || !m_pending.tryPush(cmd)) {
+                m_overflow.push_back(std::move(cmd));
+            }
+            return;
+        }
+        while (!m_pending.tryPush(cmd)) {
+            std::unique_lock<std::mutex> running(m_running, std::try_to_lock);
+            if (running.owns_lock()) {
+                m_runner = std::this_thread::get_id();
+                runPending();
+                m_runner = std::thread::id();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Leaves `cmd` with the caller and returns false if the queue is full.
+    bool trySchedule(std::unique_ptr<Command>& cmd) {
+        return m_pending.tryPush(cmd);
+    }
+
+    void setCoalescing(bool on) {
+        m_coalesce = on;
     }
 
     void runAll() {
-        while (!m_pending.empty()) {
-            std::unique_ptr<Command> cmd = std::move(m_pending.front());
-            m_pending.pop();
-            if (cmd) {
+        std::lock_guard<std::mutex> running(m_running);
+        m_runner = std::this_thread::get_id();
+        runPending();
+        m_runner = std::thread::id();
+    }
+
+private:
+    // True on the threads that run this scheduler's commands: its workers, and whoever is
+    // draining the queue.
+    bool isExecuting() const {
+        std::thread::id self = std::this_thread::get_id();
+        if (m_runner.load() == self) {
+            return true;
+        }
+        return std::any_of(m_workers.begin(), m_workers.end(),
+            [self](const std::thread& t) { return t.get_id() == self; });
+    }
+
+    // The queue first, then what overflowed it.
+    bool popPending(std::unique_ptr<Command>& cmd) {
+        if (m_pending.tryPop(cmd)) {
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(m_overflowMutex);
+        if (m_overflow.empty()) {
+            return false;
+        }
+        cmd = std::move(m_overflow.front());
+        m_overflow.pop_front();
+        return true;
+    }
+
+    void runPending() {
+        if (m_workers.empty()) {
+            // Cut into runs of one target without reordering, so messages come out as
+            // scheduled.
+            Batch batch;
+            std::unique_ptr<Command> cmd;
+            while (popPending(cmd)) {
+                if (!cmd) {
+                    continue;
+                }
+                if (!batch.empty() && !sameTarget(batch.front()->target(), cmd->target())) {
+                    runBatch(batch);
+                    batch.clear();
+                }
+                batch.push_back(std::move(cmd));
+            }
+            runBatch(batch);
+            return;
+        }
+
+        // Documents are told apart by their control block, which stays valid after the
+        // document itself is gone.
+        std::map<std::weak_ptr<Document>, size_t, std::owner_less<std::weak_ptr<Document>>> batchOf;
+        std::vector<Batch> batches;
+        std::unique_ptr<Command> cmd;
+        while (popPending(cmd)) {
+            if (!cmd) {
+                continue;
+            }
+            auto it = batchOf.try_emplace(cmd->target(), batches.size()).first;
+            if (it->second == batches.size()) {
+                batches.emplace_back();
+            }
+            batches[it->second].push_back(std::move(cmd));
+        }
+        if (batches.empty()) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_batches = std::move(batches);
+        m_nextBatch = 0;
+        m_unfinished = m_batches.size();
+        m_workReady.notify_all();
+        m_batchDone.wait(lock, [this] { return m_unfinished == 0; });
+        m_batches.clear();
+    }
+
+    // A replacement of [pos, pos + count) of the document by `text` that several edits have
+    // been folded into; `edit` is set while it holds exactly one.
+    struct Merged {
+        size_t pos = 0;
+        size_t count = 0;
+        std::string text;
+        size_t edits = 0;
+        uint64_t* edit = nullptr;
+    };
+
+    static bool sameTarget(const std::weak_ptr<Document>& a, const std::weak_ptr<Document>& b) {
+        return !a.owner_before(b) && !b.owner_before(a);
+    }
+
+    // Runs commands that all have the same target.
+    void runBatch(Batch& batch) {
+        if (batch.empty()) {
+            return;
+        }
+        std::shared_ptr<Document> doc = batch.front()->target().lock();
+        if (!doc || !m_coalesce) {
+            for (std::unique_ptr<Command>& cmd : batch) {
+                cmd->execute();
+            }
+            return;
+        }
+
+        // The document's size as if everything folded so far were applied.
+        size_t size = doc->size();
+        Merged merged;
+        Command::EditOp op;
+        for (std::unique_ptr<Command>& cmd : batch) {
+            if (!cmd->editOp(op)) {
+                flush(*doc, merged);
                 cmd->execute();
+                size = doc->size();
+                continue;
+            }
+
+            // Clamp as Document::insert() and erase() would; what is left changes the text.
+            if (op.text) {
+                op.pos = std::min(op.pos, size);
+                if (op.text->empty()) {
+                    continue;
+                }
+            } else {
+                if (op.pos > size) {
+                    continue;
+                }
+                op.count = std::min(op.count, size - op.pos);
+                if (op.count == 0) {
+                    continue;
+                }
+            }
+
+            if (merged.edits > 0 && !fold(merged, op)) {
+                flush(*doc, merged);
+            }
+            if (merged.edits == 0) {
+                merged.pos = op.pos;
+                merged.count = op.count;
+                merged.text = op.text ? *op.text : std::string();
+                merged.edit = op.edit;
+            }
+            ++merged.edits;
+            size = op.text ? size + op.text->size() : size - op.count;
+            if (merged.text.size() > kMaxMergedText) {
+                flush(*doc, merged);
+            }
+        }
+        flush(*doc, merged);
+    }
+
+    // Folds `op` into `merged` if it touches the replaced range.
+    static bool fold(Merged& merged, const Command::EditOp& op) {
+        size_t end = merged.pos + merged.text.size();
+        if (op.text) {
+            if (op.pos < merged.pos || op.pos > end) {
+                return false;
             }
+            merged.text.insert(op.pos - merged.pos, *op.text);
+            return true;
+        }
+
+        size_t opEnd = op.pos + op.count;
+        if (op.pos > end || opEnd < merged.pos) {
+            return false;
+        }
+        // Whatever the erase covers outside the replacement text is more of the document.
+        size_t before = op.pos < merged.pos ? merged.pos - op.pos : 0;
+        size_t after = opEnd > end ? opEnd - end : 0;
+        size_t first = std::max(op.pos, merged.pos) - merged.pos;
+        size_t last = std::min(opEnd, end) - merged.pos;
+        merged.text.erase(first, last - first);
+        merged.pos -= before;
+        merged.count += before + after;
+        return true;
+    }
+
+    static void flush(Document& doc, Merged& merged) {
+        if (merged.edits == 0) {
+            return;
         }
+        uint64_t id = doc.replace(merged.pos, merged.count, merged.text);
+        if (merged.edits == 1 && merged.edit) {
+            *merged.edit = id;
+        }
+        merged.edits = 0;
+        merged.text.clear();
+    }
+
+    void workerLoop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            m_workReady.wait(lock, [this] { return m_stop || m_nextBatch < m_batches.size(); });
+            if (m_stop) {
+                return;
+            }
+            Batch& batch = m_batches[m_nextBatch++];
+
+            lock.unlock();
+            runBatch(batch);
+            batch.clear();
+            lock.lock();
+
+            if (--m_unfinished == 0) {
+                m_batchDone.notify_one();
+            }
+        }
+    }
+};
+
+// A mutex-guarded std::queue with the same bound, to compare BoundedQueue against.
+template <typename T>
+class LockedQueue {
+    std::queue<T> m_items;
+    size_t m_capacity;
+    std::mutex m_mutex;
+
+public:
+    explicit LockedQueue(size_t capacity)
+        : m_capacity(capacity)
+    {
+    }
+
+    bool tryPush(T& value) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_items.size() >= m_capacity) {
+            return false;
+        }
+        m_items.push(std::move(value));
+        return true;
+    }
+
+    bool tryPop(T& out) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_items.empty()) {
+            return false;
+        }
+        out = std::move(m_items.front());
+        m_items.pop();
+        return true;
     }
 };
 
-int main() {
+// `producers` threads push `perProducer` items each while one thread pops them all; returns
+// items per second.
+template <typename Queue>
+double measureQueue(Queue& queue, unsigned producers, size_t perProducer) {
+    const size_t total = size_t(producers) * perProducer;
+    std::atomic<bool> go{ false };
+    std::vector<std::thread> threads;
+    for (unsigned p = 0; p < producers; ++p) {
+        threads.emplace_back([&queue, &go, p, perProducer] {
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            for (size_t i = 0; i < perProducer; ++i) {
+                size_t item = p * perProducer + i + 1;
+                while (!queue.tryPush(item)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    size_t popped = 0;
+    size_t sum = 0;
+    size_t item = 0;
+    while (popped < total) {
+        if (queue.tryPop(item)) {
+            ++popped;
+            sum += item;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    if (sum != total * (total + 1) / 2) {
+        std::cout << "Items were lost or duplicated.\n";
+    }
+    return total / seconds;
+}
+
+void benchmarkQueues() {
+    const unsigned producers = 32;
+    const size_t perProducer = 200000;
+    for (int round = 0; round < 3; ++round) {
+        BoundedQueue<size_t> bounded(64 * 1024);
+        LockedQueue<size_t> locked(bounded.capacity());
+        double lockFree = measureQueue(bounded, producers, perProducer);
+        double mutexed = measureQueue(locked, producers, perProducer);
+        std::cout << producers << " producers, 1 consumer: BoundedQueue " << lockFree / 1e6
+            << " M items/s, mutex + std::queue " << mutexed / 1e6 << " M items/s\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "--bench-queue") {
+        benchmarkQueues();
+        return 0;
+    }
+
     auto doc1 = std::make_shared<Document>("Hello");
     auto doc2 = std::make_shared<Document>("World");
 
@@ -170,7 +1293,34 @@ int main() {
 
     std::cout << "Final state:\n";
     std::cout << "doc1: \"" << doc1->getText() << "\"\n";
-    std::cout << "doc2: \"" << doc2->getText() << "\"\n";
+    std::cout << "doc2: \"" << doc2->getText() << "\"\n\n";
+
+    doc1->undo();
+    std::cout << "doc1 after undo: \"" << doc1->getText() << "\"\n";
+    doc1->undo();
+    std::cout << "doc1 after second undo: \"" << doc1->getText() << "\"\n";
+    doc1->redo();
+    std::cout << "doc1 after redo: \"" << doc1->getText() << "\"\n\n";
+
+    // Several rules, applied to every match in one pass.
+    auto rules = std::make_shared<const MultiReplacer>(std::vector<std::pair<std::string, std::string>>{
+        { "colour", "color" }, { "grey", "gray" }, { "centre", "center" } });
+    auto doc3 = std::make_shared<Document>("The grey centre, the grey colour.");
+    scheduler.schedule(std::make_unique<ReplaceTextCommand>(doc3, rules));
+    scheduler.runAll();
+    std::cout << "doc3 after rules: \"" << doc3->getText() << "\"\n\n";
+
+    // Many independent documents, edited on a worker pool.
+    CommandScheduler pool(0);
+    std::vector<std::shared_ptr<Document>> docs;
+    for (int i = 0; i < 1000; ++i) {
+        docs.push_back(std::make_shared<Document>("Document " + std::to_string(i)));
+        pool.schedule(std::make_unique<InsertTextCommand>(docs.back(), ", revised", docs.back()->getText().size()));
+        pool.schedule(std::make_unique<ReplaceTextCommand>(docs.back(), "Document", "Page"));
+        pool.schedule(std::make_unique<EraseTextCommand>(docs.back(), 0, 1));
+    }
+    pool.runAll();
+    std::cout << "Edited " << docs.size() << " documents in parallel, last: \"" << docs.back()->getText() << "\"\n";
 
     return 0;
 }
@@ -0,0 +1,394 @@
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "mylib.h"
+
+#if defined(__linux__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Generates a deterministic synthetic tree (on tmpfs by default, so the numbers measure the
+// scanner rather than the disk) and reports scan throughput, the peak memory of each scan and
+// per-filter latency as one JSON object on stdout. Everything is a median over --runs repetitions.
+
+struct TreeSpec {
+    unsigned depth = 3;
+    unsigned fanout = 8;
+    unsigned filesPerDir = 40;
+    std::uint64_t maxFileSize = 1 << 20;
+    std::uint64_t seed = 1;
+    // Extension and relative weight; "" makes files without an extension.
+    std::vector<std::pair<std::string, unsigned>> extensions{
+        {"txt", 20}, {"png", 8}, {"jpg", 8}, {"exe", 2}, {"log", 12}, {"cpp", 25}, {"", 25}};
+};
+
+class SplitMix {
+    std::uint64_t m_state;
+
+public:
+    explicit SplitMix(std::uint64_t seed)
+        : m_state(seed)
+    {
+    }
+
+    std::uint64_t next() {
+        std::uint64_t z = (m_state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+};
+
+struct TreeStats {
+    std::uint64_t files = 0;
+    std::uint64_t directories = 0;
+};
+
+// File sizes are log-uniform up to maxFileSize and made with resize_file, so the tree costs
+// next to no memory even on tmpfs.
+static bool generateTree(const fs::path& dir, const TreeSpec& spec, unsigned level, SplitMix& rng, TreeStats& stats) {
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (ec) {
+        return false;
+    }
+    ++stats.directories;
+
+    unsigned totalWeight = 0;
+    for (const auto& e : spec.extensions) {
+        totalWeight += e.second;
+    }
+
+    for (unsigned i = 0; i < spec.filesPerDir; ++i) {
+        unsigned pick = totalWeight == 0 ? 0 : static_cast<unsigned>(rng.next() % totalWeight);
+        std::string ext;
+        for (const auto& e : spec.extensions) {
+            if (pick < e.second) {
+                ext = e.first;
+                break;
+            }
+            pick -= e.second;
+        }
+
+        std::string name = "f" + std::to_string(i);
+        if (!ext.empty()) {
+            name += "." + ext;
+        }
+        fs::path file = dir / name;
+        std::ofstream(file, std::ios::binary).close();
+
+        unsigned bits = static_cast<unsigned>(rng.next() % (std::bit_width(spec.maxFileSize) + 1));
+        std::uint64_t size = bits == 0 ? 0 : std::min(spec.maxFileSize, (std::uint64_t{1} << (bits - 1)) + rng.next() % (std::uint64_t{1} << (bits - 1)));
+        fs::resize_file(file, size, ec);
+        if (ec) {
+            return false;
+        }
+        ++stats.files;
+    }
+
+    if (level < spec.depth) {
+        for (unsigned i = 0; i < spec.fanout; ++i) {
+            if (!generateTree(dir / ("d" + std::to_string(i)), spec, level + 1, rng, stats)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static double medianSeconds(int runs, const std::function<void()>& body) {
+    std::vector<double> times;
+    for (int i = 0; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+#if defined(__linux__)
+static std::int64_t statusKiB(const char* field) {
+    std::ifstream in("/proc/self/status");
+    for (std::string line; std::getline(in, line);) {
+        if (line.rfind(field, 0) == 0) {
+            return std::stoll(line.substr(std::char_traits<char>::length(field)));
+        }
+    }
+    return -1;
+}
+#endif
+
+// How far the peak RSS rises above the current RSS while `body` runs once. Measured in a
+// forked child whose high-water mark is reset first, so neither earlier cases nor memory the
+// allocator kept from them hide the figure. -1 where this is not supported.
+static std::int64_t peakRssGrowthKiB(const std::function<void()>& body) {
+#if defined(__linux__)
+    int fds[2];
+    if (::pipe(fds) != 0) {
+        return -1;
+    }
+    pid_t pid = ::fork();
+    if (pid == 0) {
+        ::close(fds[0]);
+        std::ofstream("/proc/self/clear_refs") << "5";
+        std::int64_t before = statusKiB("VmHWM:");
+        body();
+        std::int64_t after = statusKiB("VmHWM:");
+        std::int64_t growth = before < 0 || after < 0 ? -1 : after - before;
+        ssize_t written = ::write(fds[1], &growth, sizeof(growth));
+        ::_exit(written == sizeof(growth) ? 0 : 1);
+    }
+    ::close(fds[1]);
+    std::int64_t growth = -1;
+    if (pid < 0 || ::read(fds[0], &growth, sizeof(growth)) != sizeof(growth)) {
+        growth = -1;
+    }
+    ::close(fds[0]);
+    if (pid > 0) {
+        ::waitpid(pid, nullptr, 0);
+    }
+    return growth;
+#else
+    (void)body;
+    return -1;
+#endif
+}
+
+static std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+// A whole decimal number, or false.
+template <typename T>
+static bool parseNumber(std::string_view text, T& out) {
+    T value{};
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc() || end != text.data() + text.size()) {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+static bool parseExtensions(const std::string& text, TreeSpec& spec) {
+    spec.extensions.clear();
+    std::istringstream in(text);
+    for (std::string item; std::getline(in, item, ',');) {
+        std::size_t colon = item.find(':');
+        if (colon == std::string::npos) {
+            return false;
+        }
+        unsigned weight = 0;
+        if (!parseNumber(std::string_view(item).substr(colon + 1), weight)) {
+            return false;
+        }
+        spec.extensions.emplace_back(item.substr(0, colon), weight);
+    }
+    return !spec.extensions.empty();
+}
+
+static fs::path defaultParent() {
+    std::error_code ec;
+    if (fs::is_directory("/dev/shm", ec)) {
+        return "/dev/shm";
+    }
+    return fs::temp_directory_path(ec);
+}
+
+int main(int argc, char* argv[]) {
+    TreeSpec spec;
+    fs::path parent = defaultParent();
+    int runs = 5;
+    unsigned threads = 0;
+    bool keep = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+        auto number = [&](auto& out) {
+            std::string text = value();
+            if (parseNumber(text, out)) {
+                return true;
+            }
+            std::cerr << "Invalid value for " << arg << ": " << text << "\n";
+            return false;
+        };
+        if (arg == "--dir") {
+            parent = value();
+        } else if (arg == "--depth") {
+            if (!number(spec.depth)) {
+                return 1;
+            }
+        } else if (arg == "--fanout") {
+            if (!number(spec.fanout)) {
+                return 1;
+            }
+        } else if (arg == "--files") {
+            if (!number(spec.filesPerDir)) {
+                return 1;
+            }
+        } else if (arg == "--max-size") {
+            if (!number(spec.maxFileSize)) {
+                return 1;
+            }
+        } else if (arg == "--seed") {
+            if (!number(spec.seed)) {
+                return 1;
+            }
+        } else if (arg == "--ext") {
+            if (!parseExtensions(value(), spec)) {
+                std::cerr << "--ext expects ext:weight,ext:weight,...\n";
+                return 1;
+            }
+        } else if (arg == "--runs") {
+            if (!number(runs)) {
+                return 1;
+            }
+            runs = std::max(1, runs);
+        } else if (arg == "--threads") {
+            if (!number(threads)) {
+                return 1;
+            }
+        } else if (arg == "--keep") {
+            keep = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--dir PARENT] [--depth N] [--fanout N] [--files N] [--max-size BYTES]\n"
+                      << "       [--ext txt:20,png:8,...] [--seed N] [--runs N] [--threads N] [--keep]\n";
+            return 1;
+        }
+    }
+
+    // Only this subdirectory is ever created or removed, whatever --dir points at.
+    const fs::path root = parent / "mylib_bench_tree";
+    std::error_code ec;
+    fs::remove_all(root, ec);
+    SplitMix rng(spec.seed);
+    TreeStats tree;
+    auto genStart = std::chrono::steady_clock::now();
+    if (!generateTree(root, spec, 0, rng, tree)) {
+        std::cerr << "Error: cannot create the tree under " << root.string() << "\n";
+        return 2;
+    }
+    double genSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - genStart).count();
+    const std::uint64_t entries = tree.files + tree.directories;
+
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"tree\": {\"root\": " << jsonString(root.string()) << ", \"depth\": " << spec.depth
+         << ", \"fanout\": " << spec.fanout << ", \"files_per_dir\": " << spec.filesPerDir
+         << ", \"seed\": " << spec.seed << ", \"files\": " << tree.files << ", \"directories\": " << tree.directories
+         << ", \"generate_seconds\": " << genSec << "},\n";
+    json << "  \"runs\": " << runs << ",\n";
+
+    // Scans: one pass to warm the dentry cache, then the timed runs.
+    ScanResult r = scanDirectoryRecursive(root, ScanOptions{1});
+    struct ScanCase {
+        const char* name;
+        ScanOptions options;
+        bool streaming;
+    };
+    const ScanCase cases[] = {
+        {"serial", ScanOptions{1}, false},
+        {"parallel", ScanOptions{threads}, false},
+        {"streaming_parallel", ScanOptions{threads}, true},
+        {"serial_std_filesystem", ScanOptions{1, ScanBackend::StdFilesystem}, false},
+    };
+    json << "  \"scan\": [\n";
+    for (std::size_t c = 0; c < std::size(cases); ++c) {
+        const ScanCase& sc = cases[c];
+        double sec = medianSeconds(runs, [&] {
+            if (sc.streaming) {
+                scanDirectoryStreaming(root, {}, sc.options);
+            } else {
+                r = scanDirectoryRecursive(root, sc.options);
+            }
+        });
+        std::int64_t peakKiB = peakRssGrowthKiB([&] {
+            if (sc.streaming) {
+                scanDirectoryStreaming(root, {}, sc.options);
+            } else {
+                ScanResult kept = scanDirectoryRecursive(root, sc.options);
+            }
+        });
+        json << "    {\"name\": \"" << sc.name << "\", \"seconds\": " << sec
+             << ", \"entries_per_second\": " << static_cast<std::uint64_t>(static_cast<double>(entries) / sec)
+             << ", \"peak_rss_growth_kib\": ";
+        if (peakKiB < 0) {
+            json << "null";
+        } else {
+            json << peakKiB;
+        }
+        json << "}" << (c + 1 < std::size(cases) ? ",\n" : "\n");
+    }
+    json << "  ],\n";
+    json << "  \"memory\": {\"file_table_bytes\": " << r.files.memoryUsage() << "},\n";
+
+    // Filters: the FileTable versions fill a reused selection, the legacy ones copy FileInfos.
+    std::vector<FileInfo> legacy;
+    legacy.reserve(r.files.size());
+    for (std::size_t i = 0; i < r.files.size(); ++i) {
+        legacy.push_back(r.files.info(i));
+    }
+
+    FileSelection selection;
+    std::vector<FileInfo> copied;
+    struct FilterCase {
+        const char* name;
+        std::function<void()> table;
+        std::function<void()> vector;
+    };
+    const FilterCase filters[] = {
+        {"text", [&] { filterTextFiles(r.files, selection); }, [&] { copied = filterTextFiles(legacy); }},
+        {"image", [&] { filterImageFiles(r.files, selection); }, [&] { copied = filterImageFiles(legacy); }},
+        {"exe", [&] { filterExeFiles(r.files, selection); }, [&] { copied = filterExeFiles(legacy); }},
+        {"other", [&] { filterOtherFiles(r.files, selection); }, [&] { copied = filterOtherFiles(legacy); }},
+        {"large_gib", [&] { filterLargeFilesGiB(r.files, selection, 1); }, [&] { copied = filterLargeFilesGiB(legacy, 1); }},
+    };
+    json << "  \"filters\": [\n";
+    for (std::size_t f = 0; f < std::size(filters); ++f) {
+        double tableSec = medianSeconds(runs, filters[f].table);
+        double vectorSec = medianSeconds(runs, filters[f].vector);
+        double perFile = r.files.size() > 0 ? 1e9 / static_cast<double>(r.files.size()) : 0.0;
+        json << "    {\"name\": \"" << filters[f].name << "\", \"matches\": " << selection.size()
+             << ", \"table_ns_per_file\": " << tableSec * perFile
+             << ", \"vector_ns_per_file\": " << vectorSec * perFile << "}"
+             << (f + 1 < std::size(filters) ? ",\n" : "\n");
+    }
+    json << "  ]\n";
+    json << "}\n";
+
+    std::cout << json.str();
+
+    if (!keep) {
+        fs::remove_all(root, ec);
+    }
+    return 0;
+}
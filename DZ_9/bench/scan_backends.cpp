@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "mylib.h"
+
+// Times scanDirectoryRecursive with each backend on the same tree. The first pass warms the
+// page/dentry caches so the comparison measures syscall and allocation overhead, not disk.
+static double medianSeconds(const std::filesystem::path& root, const ScanOptions& options, int runs,
+                            ScanResult& last) {
+    std::vector<double> times;
+    for (int i = 0; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        last = scanDirectoryRecursive(root, options);
+        times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+// A whole decimal number, or false.
+template <typename T>
+static bool parseNumber(std::string_view text, T& out) {
+    T value{};
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc() || end != text.data() + text.size()) {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " <directory_path> [runs] [threads]\n";
+        return 1;
+    }
+
+    std::filesystem::path root = argv[1];
+    int runs = 5;
+    unsigned threads = 1;
+    if (argc > 2 && !parseNumber(argv[2], runs)) {
+        std::cerr << "Invalid value for runs: " << argv[2] << "\n";
+        return 1;
+    }
+    if (argc > 3 && !parseNumber(argv[3], threads)) {
+        std::cerr << "Invalid value for threads: " << argv[3] << "\n";
+        return 1;
+    }
+    runs = std::max(1, runs);
+
+    ScanResult warm = scanDirectoryRecursive(root, ScanOptions{threads, ScanBackend::StdFilesystem});
+    if (!warm.inputPathValid) {
+        std::cout << "Error: path does not exist or is not a directory.\n";
+        return 2;
+    }
+
+    ScanResult portable;
+    ScanResult native;
+    ScanResult uring;
+    double portableSec = medianSeconds(root, ScanOptions{threads, ScanBackend::StdFilesystem}, runs, portable);
+    double nativeSec = medianSeconds(root, ScanOptions{threads, ScanBackend::Getdents}, runs, native);
+    double uringSec = medianSeconds(root, ScanOptions{threads, ScanBackend::IoUring}, runs, uring);
+
+    auto identical = [&](const ScanResult& r) {
+        bool same = portable.files.size() == r.files.size() && portable.totalBytes == r.totalBytes;
+        for (std::size_t i = 0; same && i < portable.files.size(); ++i) {
+            same = portable.files.fileSize(i) == r.files.fileSize(i) && portable.files.name(i) == r.files.name(i);
+        }
+        return same;
+    };
+    bool same = identical(native) && identical(uring);
+
+    auto report = [&](const char* name, double sec) {
+        std::cout << name << ": " << sec * 1000.0 << " ms, "
+                  << static_cast<std::uint64_t>(static_cast<double>(portable.files.size()) / sec) << " files/s\n";
+    };
+
+    std::cout << "Files: " << portable.files.size() << ", directories: " << portable.files.directoryCount()
+              << ", threads: " << threads << ", runs: " << runs << "\n";
+    report("std::filesystem", portableSec);
+    report("getdents64     ", nativeSec);
+    report("io_uring statx ", uringSec);
+    std::cout << "Speedup getdents64: " << portableSec / nativeSec << "x, io_uring: " << portableSec / uringSec << "x\n";
+    std::cout << "Results identical: " << (same ? "yes" : "NO") << "\n";
+    return same ? 0 : 3;
+}
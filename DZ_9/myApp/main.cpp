@@ -1,9 +1,21 @@
 ﻿#include <iostream>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
 #include <filesystem>
+#include <iomanip>
 #include <limits>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 #include "mylib.h"
+#include "scan_watcher.h"
 
-static void printMenu() {
+static void printMenu(const CategoryMatcher* rules) {
     std::cout << "\n=== Filter menu ===\n";
     std::cout << "1) List text files (.txt)\n";
     std::cout << "2) List image files\n";
@@ -11,6 +23,12 @@ static void printMenu() {
     std::cout << "4) List large files (>= 1 GiB)\n";
     std::cout << "5) List other files\n";
     std::cout << "6) Show summary\n";
+    std::cout << "7) Largest files\n";
+    std::cout << "8) Size distribution\n";
+    std::cout << "9) Heaviest directories\n";
+    std::cout << "10) Find duplicate files\n";
+    std::cout << "11) List files of a rule category" << (rules ? "" : " (needs --rules)") << "\n";
+    std::cout << "12) Query files (e.g. ext in (jpg,png) and size > 50M and path ~ \"/var/*\")\n";
     std::cout << "0) Exit\n";
     std::cout << "Choice: ";
 }
@@ -25,34 +43,10 @@ static int readChoice() {
     return choice;
 }
 
-int main(int argc, char* argv[]) {
-    std::cout << "=== Filesystem analyzer ===\n\n";
-
-    if (argc < 2) {
-        std::cout << "Usage: " << (argc > 0 ? argv[0] : "app") << " <directory_path>\n";
-        return 1;
-    }
-
-    std::filesystem::path root = std::filesystem::path(argv[1]);
-
-    ScanResult r = scanDirectoryRecursive(root);
-
-    if (!r.inputPathValid) {
-        std::cout << "Error: path does not exist or is not a directory.\n";
-        std::cout << "Given path: " << root.string() << "\n";
-        return 2;
-    }
-
-    std::cout << "Directory: " << root.string() << "\n";
-    std::cout << "Regular files scanned: " << r.files.size() << "\n";
-    if (r.skippedEntries > 0) {
-        std::cout << "Skipped entries due to errors/permissions: " << r.skippedEntries << "\n";
-    }
-
-    printSummary(r);
-
+static void runMenu(const ScanResult& r, const CategoryMatcher* rules = nullptr) {
+    FileSelection selection;
     for (;;) {
-        printMenu();
+        printMenu(rules);
         int choice = readChoice();
 
         if (choice == 0) {
@@ -66,33 +60,89 @@ int main(int argc, char* argv[]) {
                 break;
             }
             case 1: {
-                auto list = filterTextFiles(r.files);
+                filterTextFiles(r.files, selection);
                 std::cout << "\n=== Text files (.txt) ===\n";
-                printFileList(list);
+                printFileList(r.files, selection);
                 break;
             }
             case 2: {
-                auto list = filterImageFiles(r.files);
+                filterImageFiles(r.files, selection);
                 std::cout << "\n=== Image files ===\n";
-                printFileList(list);
+                printFileList(r.files, selection);
                 break;
             }
             case 3: {
-                auto list = filterExeFiles(r.files);
+                filterExeFiles(r.files, selection);
                 std::cout << "\n=== Executables (.exe) ===\n";
-                printFileList(list);
+                printFileList(r.files, selection);
                 break;
             }
             case 4: {
-                auto list = filterLargeFilesGiB(r.files, 1);
+                filterLargeFilesGiB(r.files, selection, 1);
                 std::cout << "\n=== Large files (>= 1 GiB) ===\n";
-                printFileList(list);
+                printFileList(r.files, selection);
                 break;
             }
             case 5: {
-                auto list = filterOtherFiles(r.files);
+                filterOtherFiles(r.files, selection);
                 std::cout << "\n=== Other files ===\n";
-                printFileList(list);
+                printFileList(r.files, selection);
+                break;
+            }
+            case 7: {
+                std::cout << "\n=== Largest files ===\n";
+                printLargestFiles(r);
+                break;
+            }
+            case 8: {
+                printSizeHistogram(r);
+                break;
+            }
+            case 9: {
+                std::cout << "\n=== Heaviest directories (up to 3 levels deep) ===\n";
+                printHeaviestDirectories(r);
+                break;
+            }
+            case 10: {
+                DuplicateReport report;
+                findDuplicates(r.files, {}, report);
+                std::cout << "\n=== Duplicate files ===\n";
+                printDuplicates(r.files, report);
+                break;
+            }
+            case 11: {
+                if (!rules) {
+                    std::cout << "Rule categories are only available with --rules FILE.\n";
+                    break;
+                }
+                for (std::size_t i = 0; i < rules->categoryCount(); ++i) {
+                    std::cout << "  " << i << ") " << rules->categoryName(i) << "\n";
+                }
+                std::cout << "Category: ";
+                int category = readChoice();
+                if (category < 0 || static_cast<std::size_t>(category) >= rules->categoryCount()) {
+                    std::cout << "Invalid category.\n";
+                    break;
+                }
+                filterCategory(r.files, *rules, static_cast<std::uint16_t>(category), selection);
+                std::cout << "\n=== " << rules->categoryName(category) << " ===\n";
+                printFileList(r.files, selection);
+                break;
+            }
+            case 12: {
+                std::cout << "Query: ";
+                std::string text;
+                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                std::getline(std::cin, text);
+                FileQuery query;
+                std::string error;
+                if (!query.parse(text, error)) {
+                    std::cout << "Invalid query: " << error << "\n";
+                    break;
+                }
+                query.select(r.files, selection);
+                std::cout << "\n=== " << selection.size() << " matching files ===\n";
+                printFileList(r.files, selection);
                 break;
             }
             default: {
@@ -103,5 +153,366 @@ int main(int argc, char* argv[]) {
     }
 
     std::cout << "\n=== Done ===\n";
+}
+
+static int runWatch(const std::filesystem::path& root, const ScanOptions& options) {
+#if defined(__linux__)
+    ScanWatcher watcher;
+    if (!watcher.start(root, options)) {
+        std::cout << "Error: cannot watch " << root.string() << " (not a directory, or inotify unavailable).\n";
+        return 2;
+    }
+    std::cout << "Directory: " << root.string() << "\n";
+    std::cout << "Watching " << watcher.watchedDirectories() << " directories, Ctrl+C to stop.\n";
+    if (watcher.unwatchedDirectories() > 0) {
+        std::cout << "Not watched (raise fs.inotify.max_user_watches): " << watcher.unwatchedDirectories() << "\n";
+    }
+    printSummary(watcher.result());
+    std::cout.flush();
+
+    for (;;) {
+        if (watcher.update(std::chrono::seconds(1))) {
+            std::cout << "\n--- changes applied, " << watcher.watchedDirectories() << " directories watched";
+            if (watcher.rescans() > 0) {
+                std::cout << ", " << watcher.rescans() << " full rescans after event overflow";
+            }
+            std::cout << " ---\n";
+            printSummary(watcher.result());
+            std::cout.flush();
+        }
+    }
+#else
+    (void)root;
+    (void)options;
+    std::cout << "Error: --watch needs Linux (inotify).\n";
+    return 1;
+#endif
+}
+
+// Writes one page of a filtered, sorted listing and nothing else, for piping. `filter` is a
+// built-in filter or a FileQuery expression.
+static int runList(const ScanResult& r, const std::string& filter, const ListOptions& options) {
+    FileSelection selection;
+    if (filter == "all") {
+        selection.resize(r.files.size());
+        for (std::uint32_t i = 0; i < selection.size(); ++i) {
+            selection[i] = i;
+        }
+    } else if (filter == "text") {
+        filterTextFiles(r.files, selection);
+    } else if (filter == "image") {
+        filterImageFiles(r.files, selection);
+    } else if (filter == "exe") {
+        filterExeFiles(r.files, selection);
+    } else if (filter == "large") {
+        filterLargeFilesGiB(r.files, selection, 1);
+    } else if (filter == "other") {
+        filterOtherFiles(r.files, selection);
+    } else {
+        FileQuery query;
+        std::string error;
+        if (!query.parse(filter, error)) {
+            std::cerr << "Invalid query: " << error << "\n";
+            return 1;
+        }
+        query.select(r.files, selection);
+    }
+    writeFileList(std::cout, r.files, selection, options);
+    return 0;
+}
+
+// Rewrites one status line on stderr every second while a scan runs, so stdout stays clean.
+class ProgressLine {
+public:
+    explicit ProgressLine(const ScanProgress& progress)
+        : m_progress(progress), m_thread([this] { loop(); })
+    {
+    }
+
+    ~ProgressLine() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+        std::cerr << "\r\033[K" << std::flush;
+    }
+
+private:
+    void loop() {
+        std::unique_lock lock(m_mutex);
+        while (!m_wake.wait_for(lock, std::chrono::seconds(1), [this] { return m_stop; })) {
+            ScanCounters c = m_progress.snapshot();
+            double rate = c.elapsedSeconds > 0 ? static_cast<double>(c.entries) / c.elapsedSeconds : 0.0;
+            std::cerr << "\r\033[K" << c.entries << " entries, " << c.directories << " dirs, " << c.files
+                      << " files, " << c.bytes / (1024 * 1024) << " MiB, " << c.errorCount() << " errors, "
+                      << static_cast<std::uint64_t>(rate) << " entries/s" << std::flush;
+        }
+    }
+
+    const ScanProgress& m_progress;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+    std::thread m_thread;
+};
+
+static void printScanCounters(const ScanCounters& c, bool timing) {
+    std::cerr << "Scanned " << c.entries << " entries in " << c.directories << " directories";
+    if (c.reusedDirectories > 0) {
+        std::cerr << " (+" << c.reusedDirectories << " reused)";
+    }
+    std::cerr << ", " << c.statCalls << " stat calls, " << std::fixed << std::setprecision(2) << c.elapsedSeconds
+              << " s\n";
+    if (c.errorCount() > 0) {
+        std::cerr << "Errors:";
+        for (std::size_t e = 0; e < c.errors.size(); ++e) {
+            if (c.errors[e] > 0) {
+                std::cerr << " " << scanErrnoName(static_cast<ScanErrno>(e)) << "=" << c.errors[e];
+            }
+        }
+        std::cerr << "\n";
+    }
+    if (timing) {
+        // Summed over workers, so both can exceed the wall time.
+        std::cerr << "Worker time: syscalls " << static_cast<double>(c.syscallNs) / 1e9 << " s, classification "
+                  << static_cast<double>(c.classifyNs) / 1e9 << " s\n";
+    }
+    std::cerr << std::defaultfloat;
+}
+
+// A whole decimal number, or false.
+template <typename T>
+static bool parseNumber(std::string_view text, T& out) {
+    T value{};
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc() || end != text.data() + text.size()) {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    // A listing goes to stdout alone, so it can be piped.
+    if (std::find(argv + 1, argv + argc, std::string_view("--list")) == argv + argc) {
+        std::cout << "=== Filesystem analyzer ===\n\n";
+    }
+
+    if (argc < 2) {
+        std::cout << "Usage: " << (argc > 0 ? argv[0] : "app") << " <directory_path>... [--threads N] [--backend std|getdents|io_uring] [--summary-only] [--index FILE] [--rules FILE] [--watch]\n"
+                  << "       [--progress] [--timing]\n"
+                  << "       [--list all|text|image|exe|large|other|QUERY [--sort size|name|ext] [--desc] [--offset N] [--limit N]]\n";
+        std::cout << "       " << (argc > 0 ? argv[0] : "app") << " --snapshot FILE...\n";
+        return 1;
+    }
+
+    std::filesystem::path root = std::filesystem::path(argv[1]);
+
+    ScanResult r;
+    if (root == "--snapshot") {
+        if (argc < 3) {
+            std::cout << "Error: cannot open snapshot.\n";
+            return 2;
+        }
+        // Several snapshots, e.g. shards scanned by separate processes, are merged into one.
+        for (int i = 2; i < argc; ++i) {
+            ScanResult shard;
+            // Any file can be passed here, and the summary reads every row anyway.
+            if (!openScanIndex(argv[i], shard, true)) {
+                std::cout << "Error: cannot open snapshot " << argv[i] << ".\n";
+                return 2;
+            }
+            computeSizeStats(shard);
+            computeDirectoryUsage(shard.files, shard.usage);
+            if (i == 2) {
+                r = std::move(shard);
+            } else {
+                mergeScanResult(r, shard);
+            }
+            std::cout << "Snapshot: " << argv[i] << "\n";
+        }
+        std::cout << "Regular files: " << r.files.size() << "\n";
+        printSummary(r);
+        runMenu(r);
+        return 0;
+    }
+
+    std::vector<std::filesystem::path> roots{root};
+
+    ScanOptions options;
+    bool summaryOnly = false;
+    bool watch = false;
+    bool showProgress = false;
+    bool timing = false;
+    std::string listFilter;
+    ListOptions listOptions;
+    std::filesystem::path indexFile;
+    std::filesystem::path rulesFile;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "--threads" || arg == "-j") && i + 1 < argc) {
+            if (!parseNumber(argv[++i], options.threads)) {
+                std::cout << "Invalid thread count: " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (arg == "--backend" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "std") {
+                options.backend = ScanBackend::StdFilesystem;
+            } else if (name == "getdents") {
+                options.backend = ScanBackend::Getdents;
+            } else if (name == "io_uring") {
+                options.backend = ScanBackend::IoUring;
+            } else {
+                std::cout << "Unknown backend: " << name << "\n";
+                return 1;
+            }
+        } else if (arg == "--index" && i + 1 < argc) {
+            indexFile = argv[++i];
+        } else if (arg == "--rules" && i + 1 < argc) {
+            rulesFile = argv[++i];
+        } else if (arg == "--watch") {
+            watch = true;
+        } else if (arg == "--progress") {
+            showProgress = true;
+        } else if (arg == "--timing") {
+            timing = true;
+        } else if (arg == "--list" && i + 1 < argc) {
+            listFilter = argv[++i];
+        } else if (arg == "--sort" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "size") {
+                listOptions.order = ListOrder::Size;
+            } else if (name == "name") {
+                listOptions.order = ListOrder::Name;
+            } else if (name == "ext") {
+                listOptions.order = ListOrder::Extension;
+            } else {
+                std::cout << "Unknown sort order: " << name << "\n";
+                return 1;
+            }
+        } else if (arg == "--desc") {
+            listOptions.descending = true;
+        } else if ((arg == "--offset" || arg == "--limit") && i + 1 < argc) {
+            if (!parseNumber(argv[++i], arg == "--offset" ? listOptions.offset : listOptions.limit)) {
+                std::cout << "Invalid value for " << arg << ": " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (arg == "--summary-only") {
+            summaryOnly = true;
+        } else if (!arg.empty() && arg[0] != '-') {
+            roots.emplace_back(arg);
+        } else {
+            std::cout << "Unknown argument: " << arg << "\n";
+            return 1;
+        }
+    }
+
+    CategoryMatcher rules;
+    if (!rulesFile.empty()) {
+        std::vector<CategoryRule> ruleList;
+        std::string error;
+        if (!loadCategoryRules(rulesFile, ruleList, error) || !rules.compile(ruleList, error)) {
+            std::cout << "Error: " << error << "\n";
+            return 1;
+        }
+        options.categories = &rules;
+    }
+
+    if (watch) {
+        if (roots.size() > 1) {
+            std::cout << "Error: --watch takes a single directory.\n";
+            return 1;
+        }
+        return runWatch(root, options);
+    }
+
+    auto reportInvalidRoots = [&] {
+        for (const auto& p : roots) {
+            std::error_code ec;
+            if (!std::filesystem::is_directory(p, ec)) {
+                std::cout << "Error: path does not exist or is not a directory.\n";
+                std::cout << "Given path: " << p.string() << "\n";
+            }
+        }
+    };
+    auto printRoots = [&] {
+        for (const auto& p : roots) {
+            std::cout << "Directory: " << p.string() << "\n";
+        }
+    };
+
+    ScanResult previous;
+    if (!indexFile.empty() && loadScanIndex(indexFile, previous)) {
+        options.previous = &previous.files;
+    }
+
+    ScanProgress progress(timing);
+    std::optional<ProgressLine> progressLine;
+    if (showProgress || timing) {
+        options.progress = &progress;
+    }
+    if (showProgress) {
+        progressLine.emplace(progress);
+    }
+    auto scanDone = [&] {
+        if (options.progress) {
+            progressLine.reset();
+            printScanCounters(progress.snapshot(), timing);
+        }
+    };
+
+    // The streaming scan keeps no file table, so there would be nothing to write to an index.
+    if (summaryOnly && roots.size() == 1 && indexFile.empty()) {
+        ScanResult totals = scanDirectoryStreaming(root, {}, options);
+        scanDone();
+        if (!totals.inputPathValid) {
+            reportInvalidRoots();
+            return 2;
+        }
+        printRoots();
+        printSummary(totals);
+        return 0;
+    }
+
+    r = scanDirectories(roots, options);
+    scanDone();
+
+    if (!r.inputPathValid) {
+        reportInvalidRoots();
+        return 2;
+    }
+
+    if (!indexFile.empty()) {
+        previous = {};
+        if (!saveScanIndex(r, indexFile)) {
+            std::cout << "Warning: could not write index " << indexFile.string() << "\n";
+        }
+    }
+
+    if (summaryOnly) {
+        printRoots();
+        printSummary(r);
+        return 0;
+    }
+
+    if (!listFilter.empty()) {
+        return runList(r, listFilter, listOptions);
+    }
+
+    printRoots();
+    std::cout << "Regular files scanned: " << r.files.size() << "\n";
+    if (r.reusedDirectories > 0) {
+        std::cout << "Directories unchanged since last index: " << r.reusedDirectories << "\n";
+    }
+    if (r.skippedEntries > 0) {
+        std::cout << "Skipped entries due to errors/permissions: " << r.skippedEntries << "\n";
+    }
+
+    printSummary(r);
+
+    runMenu(r, options.categories);
     return 0;
 }
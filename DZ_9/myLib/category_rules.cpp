@@ -0,0 +1,353 @@
+#include "category_rules.h"
+#include "file_table.h"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace {
+
+constexpr std::size_t kMaxRules = 0xFFFE;
+constexpr std::size_t kMaxGlobStates = 1 << 14;
+
+unsigned char foldByte(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<unsigned char>(c + ('a' - 'A')) : c;
+}
+
+bool parseSizeRange(std::string_view s, CategoryRule& rule) {
+    std::size_t dash = s.find('-');
+    if (dash == std::string_view::npos) {
+        return false;
+    }
+    std::string_view lo = s.substr(0, dash);
+    std::string_view hi = s.substr(dash + 1);
+    if (lo.empty() && hi.empty()) {
+        return false;
+    }
+    if (!lo.empty() && !parseByteSize(lo, rule.minSize)) {
+        return false;
+    }
+    if (!hi.empty() && !parseByteSize(hi, rule.maxSize)) {
+        return false;
+    }
+    return rule.minSize < rule.maxSize;
+}
+
+// One position of the glob NFA: the token that still has to be matched, or the end of a pattern.
+enum class GlobToken : std::uint8_t { Literal, AnyOne, AnyRun, End };
+
+struct GlobPosition {
+    GlobToken token;
+    unsigned char byte;
+    std::uint16_t rule;
+};
+
+} // namespace
+
+bool parseByteSize(std::string_view s, std::uint64_t& out) {
+    std::uint64_t value = 0;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+    if (ec != std::errc{} || end == s.data()) {
+        return false;
+    }
+    std::string_view suffix(end, s.data() + s.size() - end);
+    unsigned shift = 0;
+    if (suffix.size() == 1) {
+        switch (foldByte(static_cast<unsigned char>(suffix[0]))) {
+            case 'k': shift = 10; break;
+            case 'm': shift = 20; break;
+            case 'g': shift = 30; break;
+            case 't': shift = 40; break;
+            default: return false;
+        }
+    } else if (!suffix.empty()) {
+        return false;
+    }
+    if (shift > 0 && value > (UINT64_MAX >> shift)) {
+        return false;
+    }
+    out = value << shift;
+    return true;
+}
+
+bool parseCategoryRules(std::string_view text, std::vector<CategoryRule>& out, std::string& error) {
+    std::vector<CategoryRule> rules;
+    std::istringstream in{std::string(text)};
+    std::string line;
+    for (std::size_t lineNo = 1; std::getline(in, line); ++lineNo) {
+        if (std::size_t hash = line.find('#'); hash != std::string::npos) {
+            line.resize(hash);
+        }
+        std::istringstream words(line);
+        std::string category;
+        std::string kind;
+        if (!(words >> category)) {
+            continue;
+        }
+
+        auto fail = [&](const std::string& what) {
+            error = "line " + std::to_string(lineNo) + ": " + what;
+            return false;
+        };
+
+        CategoryRule rule;
+        rule.category = category;
+        if (!(words >> kind)) {
+            return fail("missing rule kind after '" + category + "'");
+        }
+        if (kind == "ext") {
+            rule.kind = RuleKind::Extension;
+        } else if (kind == "glob") {
+            rule.kind = RuleKind::Glob;
+        } else if (kind == "size") {
+            rule.kind = RuleKind::Size;
+        } else {
+            return fail("unknown rule kind '" + kind + "' (expected ext, glob or size)");
+        }
+
+        std::size_t patterns = 0;
+        for (std::string pattern; words >> pattern; ++patterns) {
+            CategoryRule r = rule;
+            if (r.kind == RuleKind::Size) {
+                if (!parseSizeRange(pattern, r)) {
+                    return fail("bad size range '" + pattern + "'");
+                }
+            } else {
+                if (r.kind == RuleKind::Extension && pattern.front() == '.') {
+                    pattern.erase(0, 1);
+                }
+                if (pattern.empty()) {
+                    return fail("empty extension");
+                }
+                r.pattern = std::move(pattern);
+            }
+            rules.push_back(std::move(r));
+        }
+        if (patterns == 0) {
+            return fail("rule without patterns");
+        }
+    }
+
+    out = std::move(rules);
+    return true;
+}
+
+bool loadCategoryRules(const std::filesystem::path& file, std::vector<CategoryRule>& out, std::string& error) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+        error = "cannot open " + file.string();
+        return false;
+    }
+    std::ostringstream text;
+    text << in.rdbuf();
+    if (!parseCategoryRules(text.str(), out, error)) {
+        error = file.string() + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+bool CategoryMatcher::compile(const std::vector<CategoryRule>& rules, std::string& error) {
+    if (rules.size() > kMaxRules) {
+        error = "too many rules (at most " + std::to_string(kMaxRules) + ")";
+        return false;
+    }
+
+    CategoryMatcher m;
+    auto categoryId = [&](const std::string& name) {
+        auto it = std::find(m.m_names.begin(), m.m_names.end(), name);
+        if (it != m.m_names.end()) {
+            return static_cast<std::uint16_t>(it - m.m_names.begin());
+        }
+        m.m_names.push_back(name);
+        return static_cast<std::uint16_t>(m.m_names.size() - 1);
+    };
+
+    std::vector<ExtensionRule> extensions;
+    for (std::size_t i = 0; i < rules.size(); ++i) {
+        m.m_ruleCategory.push_back(categoryId(rules[i].category));
+        if (rules[i].kind == RuleKind::Extension) {
+            extensions.push_back({rules[i].pattern, static_cast<std::uint16_t>(i)});
+        }
+    }
+    m.m_unmatched = categoryId("other");
+
+    m.m_extensions = ExtensionClassifier(extensions, kNoRule);
+    if (!m.compileGlobs(rules, error)) {
+        return false;
+    }
+    m.compileSizes(rules);
+
+    *this = std::move(m);
+    return true;
+}
+
+// Subset construction over all glob patterns at once. Bytes that appear in no pattern behave
+// identically, so the alphabet is reduced to one class per distinct (case-folded) literal
+// byte plus one class for everything else.
+bool CategoryMatcher::compileGlobs(const std::vector<CategoryRule>& rules, std::string& error) {
+    std::vector<GlobPosition> positions;
+    std::vector<std::uint32_t> starts;
+    bool literal[256] = {};
+
+    for (std::size_t i = 0; i < rules.size(); ++i) {
+        if (rules[i].kind != RuleKind::Glob) {
+            continue;
+        }
+        auto rule = static_cast<std::uint16_t>(i);
+        starts.push_back(static_cast<std::uint32_t>(positions.size()));
+        for (char ch : rules[i].pattern) {
+            auto c = foldByte(static_cast<unsigned char>(ch));
+            if (c == '*') {
+                if (positions.size() > starts.back() && positions.back().token == GlobToken::AnyRun) {
+                    continue;
+                }
+                positions.push_back({GlobToken::AnyRun, 0, rule});
+            } else if (c == '?') {
+                positions.push_back({GlobToken::AnyOne, 0, rule});
+            } else {
+                positions.push_back({GlobToken::Literal, c, rule});
+                literal[c] = true;
+            }
+        }
+        positions.push_back({GlobToken::End, 0, rule});
+    }
+
+    m_classCount = 1;
+    std::uint8_t classOf[256] = {};
+    for (unsigned c = 0; c < 256; ++c) {
+        if (literal[c]) {
+            classOf[c] = static_cast<std::uint8_t>(m_classCount++);
+        }
+    }
+    for (unsigned c = 0; c < 256; ++c) {
+        m_byteClass[c] = classOf[foldByte(static_cast<unsigned char>(c))];
+    }
+
+    m_globStart = 0;
+    m_globNext.assign(m_classCount, 0);
+    m_globAccept.assign(1, kNoRule);
+    if (starts.empty()) {
+        return true;
+    }
+
+    // A '*' may match nothing, so a set of positions always includes the position after it.
+    auto close = [&](std::vector<std::uint32_t>& set) {
+        for (std::size_t k = 0; k < set.size(); ++k) {
+            if (positions[set[k]].token == GlobToken::AnyRun) {
+                set.push_back(set[k] + 1);
+            }
+        }
+        std::sort(set.begin(), set.end());
+        set.erase(std::unique(set.begin(), set.end()), set.end());
+    };
+
+    std::map<std::vector<std::uint32_t>, std::uint32_t> ids;
+    std::vector<std::vector<std::uint32_t>> sets;
+    auto stateOf = [&](std::vector<std::uint32_t> set) -> std::uint32_t {
+        if (set.empty()) {
+            return 0;
+        }
+        close(set);
+        auto [it, inserted] = ids.try_emplace(set, static_cast<std::uint32_t>(sets.size() + 1));
+        if (inserted) {
+            std::uint16_t accept = kNoRule;
+            for (std::uint32_t p : set) {
+                if (positions[p].token == GlobToken::End) {
+                    accept = std::min(accept, positions[p].rule);
+                }
+            }
+            m_globAccept.push_back(accept);
+            m_globNext.resize(m_globNext.size() + m_classCount, 0);
+            sets.push_back(std::move(set));
+        }
+        return it->second;
+    };
+
+    m_globStart = stateOf(starts);
+    std::vector<std::uint32_t> next;
+    for (std::size_t s = 0; s < sets.size(); ++s) {
+        if (sets.size() > kMaxGlobStates) {
+            error = "glob patterns are too complex (more than " + std::to_string(kMaxGlobStates) + " states)";
+            return false;
+        }
+        for (std::uint32_t cls = 0; cls < m_classCount; ++cls) {
+            next.clear();
+            for (std::uint32_t p : sets[s]) {
+                const GlobPosition& pos = positions[p];
+                if (pos.token == GlobToken::AnyRun) {
+                    next.push_back(p);
+                } else if (pos.token == GlobToken::AnyOne ||
+                           (pos.token == GlobToken::Literal && classOf[pos.byte] == cls)) {
+                    next.push_back(p + 1);
+                }
+            }
+            std::uint32_t target = stateOf(next);
+            m_globNext[(s + 1) * m_classCount + cls] = target;
+        }
+    }
+    return true;
+}
+
+// The range ends split the size axis into intervals in which the same rules apply; each
+// interval keeps only the first of them.
+void CategoryMatcher::compileSizes(const std::vector<CategoryRule>& rules) {
+    m_sizeBounds.clear();
+    m_sizeRule.clear();
+    for (const CategoryRule& r : rules) {
+        if (r.kind == RuleKind::Size) {
+            m_sizeBounds.push_back(r.minSize);
+            m_sizeBounds.push_back(r.maxSize);
+        }
+    }
+    std::sort(m_sizeBounds.begin(), m_sizeBounds.end());
+    m_sizeBounds.erase(std::unique(m_sizeBounds.begin(), m_sizeBounds.end()), m_sizeBounds.end());
+
+    m_sizeRule.assign(m_sizeBounds.size(), kNoRule);
+    for (std::size_t i = 0; i < rules.size(); ++i) {
+        const CategoryRule& r = rules[i];
+        if (r.kind != RuleKind::Size) {
+            continue;
+        }
+        auto first = std::lower_bound(m_sizeBounds.begin(), m_sizeBounds.end(), r.minSize) - m_sizeBounds.begin();
+        auto last = std::lower_bound(m_sizeBounds.begin(), m_sizeBounds.end(), r.maxSize) - m_sizeBounds.begin();
+        for (auto k = first; k < last; ++k) {
+            m_sizeRule[k] = std::min(m_sizeRule[k], static_cast<std::uint16_t>(i));
+        }
+    }
+    // An open range ends at UINT64_MAX, which is itself a size that no range includes.
+    if (!m_sizeBounds.empty() && m_sizeBounds.back() == UINT64_MAX) {
+        m_sizeRule.back() = m_sizeRule.size() > 1 ? m_sizeRule[m_sizeRule.size() - 2] : kNoRule;
+    }
+}
+
+std::uint16_t CategoryMatcher::matchGlob(std::string_view name) const {
+    std::uint32_t state = m_globStart;
+    for (char c : name) {
+        if (state == 0) {
+            return kNoRule;
+        }
+        state = m_globNext[state * m_classCount + m_byteClass[static_cast<unsigned char>(c)]];
+    }
+    return m_globAccept[state];
+}
+
+std::uint16_t CategoryMatcher::matchSize(std::uint64_t size) const {
+    auto it = std::upper_bound(m_sizeBounds.begin(), m_sizeBounds.end(), size);
+    if (it == m_sizeBounds.begin()) {
+        return kNoRule;
+    }
+    return m_sizeRule[static_cast<std::size_t>(it - m_sizeBounds.begin()) - 1];
+}
+
+std::uint16_t CategoryMatcher::match(std::string_view name, std::uint64_t size) const {
+    if (m_names.empty()) {
+        return 0;
+    }
+    std::uint16_t rule = m_extensions.lookup(extensionOf(name));
+    rule = std::min(rule, matchGlob(name));
+    rule = std::min(rule, matchSize(size));
+    return rule == kNoRule ? m_unmatched : m_ruleCategory[rule];
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "extension_classifier.h"
+
+// User-defined file categories. A rule file has one rule per line:
+//
+//   # comment
+//   logs      ext   log out err
+//   archives  glob  *.tar.gz *.tar.xz
+//   archives  ext   zip 7z rar
+//   empty     size  0-1
+//   huge      size  1G-
+//
+//   ext   extensions, with or without the leading '.', any case. Only the last extension of a
+//         name is compared (".gz" for "a.tar.gz"), so use glob for compound ones.
+//   glob  the whole file name; '*' matches any run of bytes, '?' exactly one; any case.
+//   size  MIN-MAX bytes, MAX exclusive; either side may be left out. K, M, G and T suffixes
+//         are binary (1K = 1024).
+//
+// Every pattern is a rule of its own, in file order, and the first rule that matches a file
+// decides its category. Files no rule matches go to the category "other", which is added
+// after the others unless the file names it.
+enum class RuleKind : std::uint8_t { Extension, Glob, Size };
+
+struct CategoryRule {
+    std::string category;
+    RuleKind kind = RuleKind::Extension;
+    std::string pattern;          // Extension and Glob
+    std::uint64_t minSize = 0;    // Size: [minSize, maxSize)
+    std::uint64_t maxSize = UINT64_MAX;
+};
+
+// A byte count such as "1536", "50M" or "2g"; K, M, G and T are binary suffixes in any case.
+bool parseByteSize(std::string_view text, std::uint64_t& out);
+
+// On failure `error` names the offending line and `out` is left untouched.
+bool parseCategoryRules(std::string_view text, std::vector<CategoryRule>& out, std::string& error);
+bool loadCategoryRules(const std::filesystem::path& file, std::vector<CategoryRule>& out, std::string& error);
+
+// The rules compiled into three lookups whose cost does not depend on the number of rules: a
+// perfect-hash extension table, one DFA for all globs together and the sorted breakpoints of
+// all size ranges. Each lookup yields the lowest rule index that matches; the smallest of the
+// three wins.
+class CategoryMatcher {
+public:
+    CategoryMatcher() = default;
+
+    // False (with `error` set) if there are too many rules or the globs need too many states.
+    bool compile(const std::vector<CategoryRule>& rules, std::string& error);
+
+    std::size_t categoryCount() const { return m_names.size(); }
+    const std::string& categoryName(std::size_t id) const { return m_names[id]; }
+    const std::vector<std::string>& categoryNames() const { return m_names; }
+
+    // Category id of a file, in [0, categoryCount()).
+    std::uint16_t match(std::string_view name, std::uint64_t size) const;
+
+private:
+    static constexpr std::uint16_t kNoRule = 0xFFFF;
+
+    bool compileGlobs(const std::vector<CategoryRule>& rules, std::string& error);
+    void compileSizes(const std::vector<CategoryRule>& rules);
+    std::uint16_t matchGlob(std::string_view name) const;
+    std::uint16_t matchSize(std::uint64_t size) const;
+
+    std::vector<std::string> m_names;
+    std::vector<std::uint16_t> m_ruleCategory;
+    std::uint16_t m_unmatched = 0;
+
+    ExtensionClassifier m_extensions;
+
+    // State 0 is the dead state; m_globStart is 0 when there are no glob rules.
+    std::uint8_t m_byteClass[256] = {};
+    std::uint32_t m_classCount = 1;
+    std::uint32_t m_globStart = 0;
+    std::vector<std::uint32_t> m_globNext;    // state * m_classCount + class
+    std::vector<std::uint16_t> m_globAccept;  // per state
+
+    std::vector<std::uint64_t> m_sizeBounds;  // sorted; interval i is [bounds[i], bounds[i+1])
+    std::vector<std::uint16_t> m_sizeRule;    // per interval
+};
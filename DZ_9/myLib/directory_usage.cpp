@@ -0,0 +1,100 @@
+#include "directory_usage.h"
+#include "file_table.h"
+
+#include <algorithm>
+
+void DirectoryUsage::children(std::uint32_t dir, std::vector<std::uint32_t>& out) const {
+    out.clear();
+    for (std::uint32_t c = dir + 1; c < m_subtreeEnd[dir]; c = m_subtreeEnd[c]) {
+        out.push_back(c);
+    }
+    std::ranges::stable_sort(out, [this](std::uint32_t a, std::uint32_t b) { return m_bytes[a] > m_bytes[b]; });
+}
+
+void DirectoryUsage::heaviest(std::size_t count, unsigned maxDepth, std::vector<std::uint32_t>& out) const {
+    out.clear();
+    for (std::uint32_t d = 0; d < m_bytes.size(); ++d) {
+        if (m_depth[d] <= maxDepth) {
+            out.push_back(d);
+        }
+    }
+    auto heavier = [this](std::uint32_t a, std::uint32_t b) {
+        return m_bytes[a] != m_bytes[b] ? m_bytes[a] > m_bytes[b] : a < b;
+    };
+    std::size_t n = std::min(count, out.size());
+    std::ranges::partial_sort(out, out.begin() + static_cast<std::ptrdiff_t>(n), heavier);
+    out.resize(n);
+}
+
+std::uint32_t DirectoryUsage::add(std::uint32_t depth) {
+    auto id = static_cast<std::uint32_t>(m_bytes.size());
+    m_bytes.push_back(0);
+    m_files.push_back(0);
+    m_subtreeEnd.push_back(id + 1);
+    m_depth.push_back(depth);
+    return id;
+}
+
+void DirectoryUsage::setTotals(std::uint32_t dir, std::uint64_t bytes, std::uint64_t files) {
+    m_bytes[dir] = bytes;
+    m_files[dir] = files;
+}
+
+void DirectoryUsage::setSubtreeEnd(std::uint32_t dir, std::uint32_t end) {
+    m_subtreeEnd[dir] = end;
+}
+
+void DirectoryUsage::append(const DirectoryUsage& other) {
+    const auto base = static_cast<std::uint32_t>(size());
+    reserve(size() + other.size());
+    m_bytes.insert(m_bytes.end(), other.m_bytes.begin(), other.m_bytes.end());
+    m_files.insert(m_files.end(), other.m_files.begin(), other.m_files.end());
+    m_depth.insert(m_depth.end(), other.m_depth.begin(), other.m_depth.end());
+    for (std::uint32_t end : other.m_subtreeEnd) {
+        m_subtreeEnd.push_back(end + base);
+    }
+}
+
+void DirectoryUsage::reserve(std::size_t dirs) {
+    m_bytes.reserve(dirs);
+    m_files.reserve(dirs);
+    m_subtreeEnd.reserve(dirs);
+    m_depth.reserve(dirs);
+}
+
+void DirectoryUsage::clear() {
+    m_bytes.clear();
+    m_files.clear();
+    m_subtreeEnd.clear();
+    m_depth.clear();
+}
+
+void computeDirectoryUsage(const FileTable& files, DirectoryUsage& out) {
+    const auto dirs = static_cast<std::uint32_t>(files.directoryCount());
+    out.clear();
+    out.reserve(dirs);
+    for (std::uint32_t d = 0; d < dirs; ++d) {
+        std::uint32_t parent = files.directoryParent(d);
+        out.add(parent == FileTable::kNoParent ? 0 : out.depth(parent) + 1);
+    }
+
+    std::vector<std::uint64_t> bytes(dirs);
+    std::vector<std::uint64_t> count(dirs);
+    std::span<const std::uint32_t> fileDirs = files.directoryIds();
+    std::span<const std::uint64_t> sizes = files.sizes();
+    for (std::size_t i = 0; i < fileDirs.size(); ++i) {
+        bytes[fileDirs[i]] += sizes[i];
+        ++count[fileDirs[i]];
+    }
+
+    // Parents precede their children, so one backwards pass folds every subtree into its root.
+    for (std::uint32_t d = dirs; d-- > 0;) {
+        out.setTotals(d, bytes[d], count[d]);
+        std::uint32_t parent = files.directoryParent(d);
+        if (parent != FileTable::kNoParent) {
+            bytes[parent] += bytes[d];
+            count[parent] += count[d];
+            out.setSubtreeEnd(parent, std::max(out.subtreeEnd(parent), out.subtreeEnd(d)));
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class FileTable;
+
+// du-style totals for the directories of a FileTable, indexed by directory id: the bytes and
+// regular files of each directory including everything below it. FileTable assigns directory
+// ids in pre-order, so the subtree of `dir` is exactly the id range [dir, subtreeEnd(dir)).
+class DirectoryUsage {
+public:
+    std::size_t size() const { return m_bytes.size(); }
+    bool empty() const { return m_bytes.empty(); }
+
+    std::uint64_t bytes(std::uint32_t dir) const { return m_bytes[dir]; }
+    std::uint64_t files(std::uint32_t dir) const { return m_files[dir]; }
+    std::uint32_t subtreeEnd(std::uint32_t dir) const { return m_subtreeEnd[dir]; }
+    // 0 for a scan root.
+    std::uint32_t depth(std::uint32_t dir) const { return m_depth[dir]; }
+
+    // Immediate subdirectories of `dir`, heaviest first.
+    void children(std::uint32_t dir, std::vector<std::uint32_t>& out) const;
+
+    // The `count` heaviest directories at most `maxDepth` levels below a root, heaviest first.
+    // An ancestor always weighs at least as much as its subdirectories, so a small maxDepth
+    // keeps the list from being a single chain down from the root.
+    void heaviest(std::size_t count, unsigned maxDepth, std::vector<std::uint32_t>& out) const;
+
+    // Directories must be added in pre-order; the totals and subtree end are set afterwards.
+    std::uint32_t add(std::uint32_t depth);
+    void setTotals(std::uint32_t dir, std::uint64_t bytes, std::uint64_t files);
+    void setSubtreeEnd(std::uint32_t dir, std::uint32_t end);
+    // For FileTable::append: `other`'s directories follow this one's.
+    void append(const DirectoryUsage& other);
+    void reserve(std::size_t dirs);
+    void clear();
+
+private:
+    std::vector<std::uint64_t> m_bytes;
+    std::vector<std::uint64_t> m_files;
+    std::vector<std::uint32_t> m_subtreeEnd;
+    std::vector<std::uint32_t> m_depth;
+};
+
+// Rebuilds the totals from the table itself in one serial pass, for tables that did not come
+// from scanDirectoryRecursive (loadScanIndex/openScanIndex).
+void computeDirectoryUsage(const FileTable& files, DirectoryUsage& out);
@@ -0,0 +1,456 @@
+#include "duplicates.h"
+#include "file_table.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <span>
+#include <thread>
+
+#if defined(_WIN32)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr std::size_t kPrefixBytes = 4096;
+constexpr std::size_t kReadBytes = 1 << 20;
+
+// Streaming XXH64. Two instances with different seeds make up the 128-bit content digest.
+class Xxh64 {
+    static constexpr std::uint64_t P1 = 0x9E3779B185EBCA87ull;
+    static constexpr std::uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+    static constexpr std::uint64_t P3 = 0x165667B19E3779F9ull;
+    static constexpr std::uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+    static constexpr std::uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+    std::uint64_t m_seed;
+    std::uint64_t m_v[4];
+    std::uint64_t m_total = 0;
+    unsigned char m_buffer[32];
+    std::size_t m_buffered = 0;
+
+    static std::uint64_t rotl(std::uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static std::uint64_t read64(const unsigned char* p) {
+        std::uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static std::uint32_t read32(const unsigned char* p) {
+        std::uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static std::uint64_t round(std::uint64_t acc, std::uint64_t input) {
+        return rotl(acc + input * P2, 31) * P1;
+    }
+
+    static std::uint64_t mergeRound(std::uint64_t acc, std::uint64_t v) {
+        return (acc ^ round(0, v)) * P1 + P4;
+    }
+
+    void stripes(const unsigned char* p, std::size_t n) {
+        for (; n >= 32; p += 32, n -= 32) {
+            m_v[0] = round(m_v[0], read64(p));
+            m_v[1] = round(m_v[1], read64(p + 8));
+            m_v[2] = round(m_v[2], read64(p + 16));
+            m_v[3] = round(m_v[3], read64(p + 24));
+        }
+    }
+
+public:
+    explicit Xxh64(std::uint64_t seed)
+        : m_seed(seed), m_v{seed + P1 + P2, seed + P2, seed, seed - P1}
+    {
+    }
+
+    void update(const unsigned char* p, std::size_t n) {
+        m_total += n;
+        if (m_buffered > 0) {
+            std::size_t take = std::min(n, 32 - m_buffered);
+            std::memcpy(m_buffer + m_buffered, p, take);
+            m_buffered += take;
+            p += take;
+            n -= take;
+            if (m_buffered < 32) {
+                return;
+            }
+            stripes(m_buffer, 32);
+            m_buffered = 0;
+        }
+        std::size_t whole = n & ~std::size_t{31};
+        stripes(p, whole);
+        std::memcpy(m_buffer, p + whole, n - whole);
+        m_buffered = n - whole;
+    }
+
+    std::uint64_t digest() const {
+        std::uint64_t h;
+        if (m_total >= 32) {
+            h = rotl(m_v[0], 1) + rotl(m_v[1], 7) + rotl(m_v[2], 12) + rotl(m_v[3], 18);
+            for (std::uint64_t v : m_v) {
+                h = mergeRound(h, v);
+            }
+        } else {
+            h = m_seed + P5;
+        }
+        h += m_total;
+
+        const unsigned char* p = m_buffer;
+        std::size_t n = m_buffered;
+        for (; n >= 8; p += 8, n -= 8) {
+            h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+        }
+        if (n >= 4) {
+            h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+            p += 4;
+            n -= 4;
+        }
+        for (; n > 0; ++p, --n) {
+            h = rotl(h ^ (*p * P5), 11) * P1;
+        }
+
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+};
+
+struct Digest {
+    std::uint64_t lo = 0;
+    std::uint64_t hi = 0;
+
+    auto operator<=>(const Digest&) const = default;
+};
+
+class ContentHasher {
+    Xxh64 m_lo{0};
+    Xxh64 m_hi{0x5DEECE66Dull};
+
+public:
+    void update(const unsigned char* p, std::size_t n) {
+        m_lo.update(p, n);
+        m_hi.update(p, n);
+    }
+
+    Digest digest() const { return {m_lo.digest(), m_hi.digest()}; }
+};
+
+// Plain blocking reads into the caller's buffer; no stdio or stream buffering in between.
+class FileReader {
+#if defined(_WIN32)
+    std::ifstream m_in;
+#else
+    int m_fd = -1;
+#endif
+
+public:
+    FileReader() = default;
+    FileReader(const FileReader&) = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    ~FileReader() {
+#if !defined(_WIN32)
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+#endif
+    }
+
+    bool open(const fs::path& path, bool sequential) {
+#if defined(_WIN32)
+        (void)sequential;
+        m_in.open(path, std::ios::binary);
+        return static_cast<bool>(m_in);
+#else
+        m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (m_fd < 0) {
+            return false;
+        }
+#if defined(__linux__)
+        if (sequential) {
+            ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+#else
+        (void)sequential;
+#endif
+        return true;
+#endif
+    }
+
+    // Fills as much of the buffer as the file has left; -1 on a read error.
+    std::int64_t read(unsigned char* buffer, std::size_t n) {
+#if defined(_WIN32)
+        m_in.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(n));
+        if (m_in.bad()) {
+            return -1;
+        }
+        return static_cast<std::int64_t>(m_in.gcount());
+#else
+        std::size_t done = 0;
+        while (done < n) {
+            ssize_t got = ::read(m_fd, buffer + done, n - done);
+            if (got < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            if (got == 0) {
+                break;
+            }
+            done += static_cast<std::size_t>(got);
+        }
+        return static_cast<std::int64_t>(done);
+#endif
+    }
+};
+
+struct Candidate {
+    std::uint32_t row;
+    std::uint64_t size;
+    Digest digest;
+    bool readable = true;
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;  // 0: unknown, never collapsed
+};
+
+// Runs `work` on `threads` threads, the calling thread being one of them.
+template <typename Work>
+void runOnThreads(unsigned threads, const Work& work) {
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (auto& t : pool) {
+        t.join();
+    }
+}
+
+// Hashes the first `limit` bytes of the file (all of it for UINT64_MAX). The file must still
+// have the size recorded in the table, otherwise it is treated as unreadable.
+bool hashFile(const fs::path& path, std::uint64_t size, std::uint64_t limit, std::vector<unsigned char>& buffer,
+              Digest& out, std::uint64_t& bytesRead) {
+    FileReader file;
+    if (!file.open(path, limit > kPrefixBytes)) {
+        return false;
+    }
+
+    const std::uint64_t want = std::min(size, limit);
+    ContentHasher hasher;
+    std::uint64_t done = 0;
+    while (done < want) {
+        std::size_t chunk = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), want - done));
+        std::int64_t got = file.read(buffer.data(), chunk);
+        if (got <= 0) {
+            return false;
+        }
+        hasher.update(buffer.data(), static_cast<std::size_t>(got));
+        done += static_cast<std::uint64_t>(got);
+    }
+    bytesRead += done;
+
+    // A file that grew since the scan would otherwise pass as its own prefix.
+    if (want == size) {
+        unsigned char extra;
+        if (file.read(&extra, 1) != 0) {
+            return false;
+        }
+    }
+
+    out = hasher.digest();
+    return true;
+}
+
+void hashAll(const FileTable& files, std::vector<Candidate>& candidates, std::uint64_t limit, unsigned threads,
+             std::uint64_t& bytesRead) {
+    if (candidates.empty()) {
+        return;
+    }
+    std::atomic<std::size_t> next{0};
+    std::atomic<std::uint64_t> totalRead{0};
+
+    auto work = [&] {
+        std::vector<unsigned char> buffer(limit > kPrefixBytes ? kReadBytes : kPrefixBytes);
+        std::uint64_t read = 0;
+        for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < candidates.size();) {
+            Candidate& c = candidates[i];
+            c.readable = hashFile(files.path(c.row), c.size, limit, buffer, c.digest, read);
+        }
+        totalRead.fetch_add(read, std::memory_order_relaxed);
+    };
+
+    runOnThreads(static_cast<unsigned>(std::min<std::size_t>(threads, candidates.size())), work);
+    bytesRead += totalRead.load();
+}
+
+// Fills in device and inode. Where they cannot be had, the candidate keeps inode 0.
+void identifyAll(const FileTable& files, std::vector<Candidate>& candidates, unsigned threads) {
+#if defined(_WIN32)
+    (void)files;
+    (void)candidates;
+    (void)threads;
+#else
+    if (candidates.empty()) {
+        return;
+    }
+    std::atomic<std::size_t> next{0};
+    auto work = [&] {
+        for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < candidates.size();) {
+            Candidate& c = candidates[i];
+            struct stat st;
+            if (::stat(files.path(c.row).c_str(), &st) == 0) {
+                c.device = static_cast<std::uint64_t>(st.st_dev);
+                c.inode = static_cast<std::uint64_t>(st.st_ino);
+            }
+        }
+    };
+    runOnThreads(static_cast<unsigned>(std::min<std::size_t>(threads, candidates.size())), work);
+#endif
+}
+
+// Keeps the first row of every (device, inode) and moves the others to `links` as
+// (kept row, other row) pairs, sorted by kept row.
+void collapseLinks(std::vector<Candidate>& candidates, std::vector<std::pair<std::uint32_t, std::uint32_t>>& links) {
+    std::ranges::sort(candidates, [](const Candidate& a, const Candidate& b) {
+        if (a.device != b.device) {
+            return a.device < b.device;
+        }
+        if (a.inode != b.inode) {
+            return a.inode < b.inode;
+        }
+        return a.row < b.row;
+    });
+
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < candidates.size();) {
+        std::size_t j = i + 1;
+        if (candidates[i].inode != 0) {
+            while (j < candidates.size() && candidates[j].device == candidates[i].device &&
+                   candidates[j].inode == candidates[i].inode) {
+                links.emplace_back(candidates[i].row, candidates[j].row);
+                ++j;
+            }
+        }
+        candidates[kept++] = candidates[i];
+        i = j;
+    }
+    candidates.resize(kept);
+    std::ranges::sort(links);
+}
+
+// Keeps only candidates whose (size, digest) occurs at least twice; drops unreadable ones.
+std::size_t keepMatches(std::vector<Candidate>& candidates, std::uint64_t& unreadable) {
+    auto bad = std::ranges::remove_if(candidates, [](const Candidate& c) { return !c.readable; });
+    unreadable += static_cast<std::uint64_t>(bad.size());
+    candidates.erase(bad.begin(), bad.end());
+
+    std::ranges::sort(candidates, [](const Candidate& a, const Candidate& b) {
+        if (a.size != b.size) {
+            return a.size < b.size;
+        }
+        if (a.digest != b.digest) {
+            return a.digest < b.digest;
+        }
+        return a.row < b.row;
+    });
+
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < candidates.size();) {
+        std::size_t j = i + 1;
+        while (j < candidates.size() && candidates[j].size == candidates[i].size &&
+               candidates[j].digest == candidates[i].digest) {
+            ++j;
+        }
+        if (j - i > 1) {
+            std::move(candidates.begin() + static_cast<std::ptrdiff_t>(i),
+                      candidates.begin() + static_cast<std::ptrdiff_t>(j),
+                      candidates.begin() + static_cast<std::ptrdiff_t>(kept));
+            kept += j - i;
+        }
+        i = j;
+    }
+    candidates.resize(kept);
+    return kept;
+}
+
+} // namespace
+
+void findDuplicates(const FileTable& files, const DuplicateOptions& options, DuplicateReport& out) {
+    out = {};
+    unsigned threads = options.threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : options.threads;
+
+    // Stage 1: sizes only, straight from the table.
+    std::vector<Candidate> candidates;
+    std::span<const std::uint64_t> sizes = files.sizes();
+    for (std::size_t i = 0; i < sizes.size(); ++i) {
+        if (sizes[i] >= options.minSize) {
+            candidates.push_back({static_cast<std::uint32_t>(i), sizes[i], {}});
+        }
+    }
+    keepMatches(candidates, out.unreadable);
+
+    // Hard links of one file: only the first row is read, and they are not duplicates.
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> links;
+    identifyAll(files, candidates, threads);
+    collapseLinks(candidates, links);
+    out.linkedNames = links.size();
+    keepMatches(candidates, out.unreadable);
+    out.sizeCandidates = candidates.size();
+
+    // Stage 2: the first 4 KiB, which for small files is the whole file.
+    hashAll(files, candidates, kPrefixBytes, threads, out.bytesRead);
+    keepMatches(candidates, out.unreadable);
+    out.prefixCandidates = candidates.size();
+
+    // Stage 3: everything, only for the larger files still in a group.
+    std::vector<Candidate> large;
+    std::erase_if(candidates, [&](const Candidate& c) {
+        if (c.size > kPrefixBytes) {
+            large.push_back(c);
+            return true;
+        }
+        return false;
+    });
+    hashAll(files, large, UINT64_MAX, threads, out.bytesRead);
+    out.fullyHashed = large.size();
+    keepMatches(large, out.unreadable);
+    candidates.insert(candidates.end(), large.begin(), large.end());
+    keepMatches(candidates, out.unreadable);
+
+    for (std::size_t i = 0; i < candidates.size();) {
+        DuplicateGroup g;
+        g.size = candidates[i].size;
+        std::size_t j = i;
+        for (; j < candidates.size() && candidates[j].size == g.size && candidates[j].digest == candidates[i].digest; ++j) {
+            g.files.push_back(candidates[j].row);
+            auto named = std::ranges::equal_range(links, candidates[j].row, {}, &std::pair<std::uint32_t, std::uint32_t>::first);
+            for (const auto& link : named) {
+                g.links.push_back(link.second);
+            }
+        }
+        std::ranges::sort(g.links);
+        out.wastedBytes += g.size * (g.files.size() - 1);
+        out.groups.push_back(std::move(g));
+        i = j;
+    }
+
+    std::ranges::stable_sort(out.groups, [](const DuplicateGroup& a, const DuplicateGroup& b) {
+        return a.size * (a.files.size() - 1) > b.size * (b.files.size() - 1);
+    });
+}
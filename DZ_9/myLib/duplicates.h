@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class FileTable;
+
+struct DuplicateGroup {
+    std::uint64_t size = 0;
+    std::vector<std::uint32_t> files;  // FileTable rows, in table order, one per distinct file
+    std::vector<std::uint32_t> links;  // further names (hard links) of those files; no waste
+};
+
+struct DuplicateOptions {
+    // Reader threads; 0 uses std::thread::hardware_concurrency().
+    unsigned threads = 0;
+    // Smaller files are ignored; the default leaves out empty files, which all match.
+    std::uint64_t minSize = 1;
+};
+
+struct DuplicateReport {
+    // Largest waste (size * (files - 1)) first.
+    std::vector<DuplicateGroup> groups;
+
+    // How far each stage got, to see that the staging works.
+    std::uint64_t linkedNames = 0;       // rows that name a file already listed (same device and inode)
+    std::uint64_t sizeCandidates = 0;    // files sharing their size with another file
+    std::uint64_t prefixCandidates = 0;  // ... and their first 4 KiB
+    std::uint64_t fullyHashed = 0;       // files read to the end (the first read covers small files)
+    std::uint64_t bytesRead = 0;
+    std::uint64_t unreadable = 0;        // could not be opened, or changed size while reading
+    std::uint64_t wastedBytes = 0;
+};
+
+// Finds files with identical contents among the rows of `files`, in three stages: files are
+// grouped by size, files that share a size are told apart by a hash of their first 4 KiB, and
+// only files that still match are hashed in full with large sequential reads. Most files are
+// never read at all, and most of the rest never past the first 4 KiB. Both hashing stages run
+// on a pool of reader threads.
+//
+// Rows that share a size are stat()ed first, and rows naming the same file (device and inode)
+// go on as one, so hard links are neither read twice nor counted as waste.
+//
+// Contents are compared through a 128-bit non-cryptographic hash, which is safe against
+// accidental collisions but not against files crafted to collide.
+void findDuplicates(const FileTable& files, const DuplicateOptions& options, DuplicateReport& out);
@@ -0,0 +1,82 @@
+#include "extension_classifier.h"
+
+#include <algorithm>
+#include <cctype>
+
+static std::string foldExtension(std::string_view ext) {
+    if (!ext.empty() && ext.front() == '.') {
+        ext.remove_prefix(1);
+    }
+    std::string s(ext);
+    std::ranges::transform(s, s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+ExtensionClassifier::ExtensionClassifier(std::span<const ExtensionRule> rules, std::uint16_t fallback)
+    : m_fallback(fallback)
+{
+    m_values.assign(m_values.size(), fallback);
+
+    std::vector<std::uint64_t> keys;
+    std::vector<std::uint16_t> values;
+    for (const ExtensionRule& r : rules) {
+        std::uint64_t key = ext_hash::packKey(r.extension);
+        if (key != ext_hash::kNoKey) {
+            if (std::find(keys.begin(), keys.end(), key) == keys.end()) {
+                keys.push_back(key);
+                values.push_back(r.value);
+            }
+            continue;
+        }
+
+        std::string folded = foldExtension(r.extension);
+        if (folded.empty()) {
+            continue;
+        }
+        auto same = [&](const auto& e) { return e.first == folded; };
+        if (std::find_if(m_long.begin(), m_long.end(), same) == m_long.end()) {
+            m_long.emplace_back(std::move(folded), r.value);
+        }
+    }
+
+    if (keys.empty()) {
+        return;
+    }
+
+    // Start at about twice the key count and widen until a perfect multiplier turns up.
+    unsigned bits = 1;
+    while ((std::size_t{1} << bits) < keys.size() * 2) {
+        ++bits;
+    }
+    for (;; ++bits) {
+        std::uint64_t m = ext_hash::findMultiplier(keys, keys.size(), bits);
+        if (m == 0) {
+            continue;
+        }
+        m_bits = bits;
+        m_multiplier = m;
+        m_keys.assign(std::size_t{1} << bits, ext_hash::kNoKey);
+        m_values.assign(std::size_t{1} << bits, fallback);
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            std::size_t s = ext_hash::slotOf(keys[i], m, bits);
+            m_keys[s] = keys[i];
+            m_values[s] = values[i];
+        }
+        return;
+    }
+}
+
+std::uint16_t ExtensionClassifier::lookupLong(std::string_view ext) const {
+    if (!ext.empty() && ext.front() == '.') {
+        ext.remove_prefix(1);
+    }
+    for (const auto& [name, value] : m_long) {
+        if (name.size() == ext.size() &&
+            std::equal(name.begin(), name.end(), ext.begin(), [](char a, char b) {
+                return a == static_cast<char>(std::tolower(static_cast<unsigned char>(b)));
+            })) {
+            return value;
+        }
+    }
+    return m_fallback;
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Maps a file extension to a small integer (a category id) without allocating and without
+// hashing std::string. Extensions of up to 8 bytes are folded to lower case and packed into
+// one 64-bit key; a multiply-shift hash whose multiplier is searched for at build time puts
+// every key of the table into its own slot, so a lookup is one multiply, one load and one
+// compare. The built-in table is built by the compiler; user tables use the same code at
+// runtime.
+
+struct ExtensionRule {
+    std::string_view extension;  // with or without the leading '.', any case
+    std::uint16_t value;
+};
+
+namespace ext_hash {
+
+constexpr std::uint64_t kNoKey = 0;
+
+// 0 for an empty extension or one longer than 8 bytes.
+constexpr std::uint64_t packKey(std::string_view ext) {
+    if (!ext.empty() && ext.front() == '.') {
+        ext.remove_prefix(1);
+    }
+    if (ext.empty() || ext.size() > 8) {
+        return kNoKey;
+    }
+    std::uint64_t key = 0;
+    for (std::size_t i = 0; i < ext.size(); ++i) {
+        auto c = static_cast<unsigned char>(ext[i]);
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<unsigned char>(c + ('a' - 'A'));
+        }
+        key |= static_cast<std::uint64_t>(c) << (8 * i);
+    }
+    return key;
+}
+
+constexpr std::uint64_t multiplierCandidate(std::uint64_t i) {
+    std::uint64_t z = i * 0x9E3779B97F4A7C15ull + 0x632BE59BD9B4E019ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (z ^ (z >> 31)) | 1;
+}
+
+constexpr std::size_t slotOf(std::uint64_t key, std::uint64_t multiplier, unsigned bits) {
+    return static_cast<std::size_t>((key * multiplier) >> (64 - bits));
+}
+
+constexpr unsigned kMultiplierAttempts = 4096;
+
+// Tries multipliers until all keys land in distinct slots; 0 if none was found.
+template <typename Keys>
+constexpr std::uint64_t findMultiplier(const Keys& keys, std::size_t count, unsigned bits) {
+    for (unsigned attempt = 0; attempt < kMultiplierAttempts; ++attempt) {
+        std::uint64_t m = multiplierCandidate(attempt);
+        std::vector<bool> used(std::size_t{1} << bits);
+        bool perfect = true;
+        for (std::size_t i = 0; i < count && perfect; ++i) {
+            std::size_t s = slotOf(keys[i], m, bits);
+            perfect = !used[s];
+            used[s] = true;
+        }
+        if (perfect) {
+            return m;
+        }
+    }
+    return 0;
+}
+
+} // namespace ext_hash
+
+template <unsigned Bits>
+class StaticExtensionTable {
+public:
+    std::array<std::uint64_t, std::size_t{1} << Bits> keys{};
+    std::array<std::uint16_t, std::size_t{1} << Bits> values{};
+    std::uint64_t multiplier = 0;
+    std::uint16_t fallback = 0;
+
+    constexpr std::uint16_t lookup(std::string_view ext) const {
+        std::uint64_t key = ext_hash::packKey(ext);
+        std::size_t s = ext_hash::slotOf(key, multiplier, Bits);
+        return key != ext_hash::kNoKey && keys[s] == key ? values[s] : fallback;
+    }
+};
+
+// Every rule extension must fit in 8 bytes; a table that cannot be made perfect fails to compile.
+template <unsigned Bits, std::size_t N>
+consteval StaticExtensionTable<Bits> makeStaticExtensionTable(const ExtensionRule (&rules)[N], std::uint16_t fallback) {
+    static_assert(N <= (std::size_t{1} << Bits), "table too small");
+
+    std::array<std::uint64_t, N> keys{};
+    for (std::size_t i = 0; i < N; ++i) {
+        keys[i] = ext_hash::packKey(rules[i].extension);
+        if (keys[i] == ext_hash::kNoKey) {
+            throw "extension must be 1..8 bytes";
+        }
+    }
+
+    StaticExtensionTable<Bits> t;
+    t.fallback = fallback;
+    t.multiplier = ext_hash::findMultiplier(keys, N, Bits);
+    if (t.multiplier == 0) {
+        throw "no perfect multiplier; use more bits";
+    }
+    for (std::size_t i = 0; i < N; ++i) {
+        std::size_t s = ext_hash::slotOf(keys[i], t.multiplier, Bits);
+        t.keys[s] = keys[i];
+        t.values[s] = rules[i].value;
+    }
+    return t;
+}
+
+// Runtime counterpart for user-defined tables. Extensions longer than 8 bytes do not fit the
+// packed key and are kept in a small side list that is only consulted for such extensions.
+// When a rule repeats an extension, the first one wins.
+class ExtensionClassifier {
+public:
+    ExtensionClassifier() = default;
+    ExtensionClassifier(std::span<const ExtensionRule> rules, std::uint16_t fallback);
+
+    std::uint16_t lookup(std::string_view ext) const {
+        std::uint64_t key = ext_hash::packKey(ext);
+        if (key == ext_hash::kNoKey) {
+            return m_long.empty() ? m_fallback : lookupLong(ext);
+        }
+        std::size_t s = ext_hash::slotOf(key, m_multiplier, m_bits);
+        return m_keys[s] == key ? m_values[s] : m_fallback;
+    }
+
+    std::uint16_t fallback() const { return m_fallback; }
+
+private:
+    std::uint16_t lookupLong(std::string_view ext) const;
+
+    std::vector<std::uint64_t> m_keys{ext_hash::kNoKey, ext_hash::kNoKey};
+    std::vector<std::uint16_t> m_values{0, 0};
+    std::uint64_t m_multiplier = 1;
+    unsigned m_bits = 1;
+    std::uint16_t m_fallback = 0;
+    std::vector<std::pair<std::string, std::uint16_t>> m_long;
+};
@@ -0,0 +1,235 @@
+#include "file_listing.h"
+#include "file_table.h"
+
+#include <algorithm>
+#include <charconv>
+#include <compare>
+#include <numeric>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Below this many rows per thread the threads cost more than they save.
+constexpr std::size_t kMinRowsPerThread = 32 * 1024;
+constexpr std::size_t kBufferBytes = 1 << 20;
+
+template <typename Fn>
+void runParallel(std::size_t tasks, const Fn& fn) {
+    std::vector<std::thread> pool;
+    pool.reserve(tasks);
+    for (std::size_t i = 0; i < tasks; ++i) {
+        pool.emplace_back([&fn, i] { fn(i); });
+    }
+    for (std::thread& t : pool) {
+        t.join();
+    }
+}
+
+// Sorts `rows` so that its first `keep` elements are the smallest under `less`, in order;
+// the rest is left in no particular order, or dropped when `keep` < rows.size() and the sort
+// ran on several threads.
+template <typename Less>
+void parallelSort(std::vector<std::uint32_t>& rows, const Less& less, unsigned threads, std::size_t keep) {
+    const std::size_t n = rows.size();
+    keep = std::min(keep, n);
+    const std::size_t chunks = std::min<std::size_t>(threads, n / kMinRowsPerThread);
+
+    if (chunks <= 1) {
+        if (keep < n) {
+            std::partial_sort(rows.begin(), rows.begin() + static_cast<std::ptrdiff_t>(keep), rows.end(), less);
+        } else {
+            std::sort(rows.begin(), rows.end(), less);
+        }
+        return;
+    }
+
+    std::vector<std::size_t> bounds(chunks + 1);
+    for (std::size_t i = 0; i <= chunks; ++i) {
+        bounds[i] = n * i / chunks;
+    }
+    auto at = [&](std::size_t i) { return rows.begin() + static_cast<std::ptrdiff_t>(bounds[i]); };
+
+    runParallel(chunks, [&](std::size_t i) {
+        std::size_t length = bounds[i + 1] - bounds[i];
+        if (keep < length) {
+            std::partial_sort(at(i), at(i) + static_cast<std::ptrdiff_t>(keep), at(i + 1), less);
+        } else {
+            std::sort(at(i), at(i + 1), less);
+        }
+    });
+
+    if (keep < n) {
+        // A page: only the first `keep` of each chunk can make it, pick from those.
+        std::vector<std::uint32_t> candidates;
+        candidates.reserve(chunks * keep);
+        for (std::size_t i = 0; i < chunks; ++i) {
+            std::size_t length = std::min(keep, bounds[i + 1] - bounds[i]);
+            candidates.insert(candidates.end(), at(i), at(i) + static_cast<std::ptrdiff_t>(length));
+        }
+        std::partial_sort(candidates.begin(), candidates.begin() + static_cast<std::ptrdiff_t>(keep), candidates.end(),
+                          less);
+        candidates.resize(keep);
+        rows = std::move(candidates);
+        return;
+    }
+
+    for (std::size_t width = 1; width < chunks; width *= 2) {
+        std::size_t pairs = (chunks + 2 * width - 1) / (2 * width);
+        runParallel(pairs, [&](std::size_t p) {
+            std::size_t first = p * 2 * width;
+            std::size_t middle = first + width;
+            if (middle < chunks) {
+                std::inplace_merge(at(first), at(middle), at(std::min(first + 2 * width, chunks)), less);
+            }
+        });
+    }
+}
+
+// Compares rows by `key` and then by row, so every order is total and deterministic.
+template <typename Key>
+auto rowLess(Key key, bool descending) {
+    return [key, descending](std::uint32_t a, std::uint32_t b) {
+        auto c = key(a, b);
+        if (c != 0) {
+            return descending ? c > 0 : c < 0;
+        }
+        return a < b;
+    };
+}
+
+void sortRows(const FileTable& files, std::vector<std::uint32_t>& rows, ListOrder order, bool descending,
+              unsigned threads, std::size_t keep) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    switch (order) {
+        case ListOrder::Table:
+            parallelSort(rows, [descending](std::uint32_t a, std::uint32_t b) { return descending ? a > b : a < b; },
+                         threads, keep);
+            break;
+        case ListOrder::Size: {
+            const std::uint64_t* sizes = files.sizes().data();
+            parallelSort(rows, rowLess([sizes](std::uint32_t a, std::uint32_t b) { return sizes[a] <=> sizes[b]; },
+                                       descending), threads, keep);
+            break;
+        }
+        case ListOrder::Name:
+            parallelSort(rows, rowLess([&files](std::uint32_t a, std::uint32_t b) {
+                return files.name(a) <=> files.name(b);
+            }, descending), threads, keep);
+            break;
+        case ListOrder::Extension: {
+            // Extensions are interned; compare their ranks instead of their strings.
+            std::vector<std::uint32_t> byName(files.extensionCount());
+            std::iota(byName.begin(), byName.end(), 0u);
+            std::sort(byName.begin(), byName.end(), [&](std::uint32_t a, std::uint32_t b) {
+                return files.extensionName(a) < files.extensionName(b);
+            });
+            std::vector<std::uint32_t> rank(byName.size());
+            for (std::uint32_t r = 0; r < byName.size(); ++r) {
+                rank[byName[r]] = r;
+            }
+            parallelSort(rows, rowLess([&files, &rank](std::uint32_t a, std::uint32_t b) {
+                auto c = rank[files.extensionId(a)] <=> rank[files.extensionId(b)];
+                return c != 0 ? c : files.name(a) <=> files.name(b);
+            }, descending), threads, keep);
+            break;
+        }
+    }
+}
+
+class LineWriter {
+public:
+    explicit LineWriter(std::ostream& out)
+        : m_out(out)
+    {
+        m_buffer.reserve(kBufferBytes + 4096);
+    }
+
+    ~LineWriter() { flush(); }
+
+    void append(std::string_view s) { m_buffer.append(s); }
+
+    void append(std::uint64_t v) {
+        char digits[20];
+        auto end = std::to_chars(digits, digits + sizeof(digits), v).ptr;
+        m_buffer.append(digits, end);
+    }
+
+    void endLine() {
+        m_buffer.push_back('\n');
+        if (m_buffer.size() >= kBufferBytes) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (!m_buffer.empty()) {
+            m_out.write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+            m_buffer.clear();
+        }
+    }
+
+private:
+    std::ostream& m_out;
+    std::string m_buffer;
+};
+
+} // namespace
+
+void sortFileRows(const FileTable& files, std::vector<std::uint32_t>& rows, ListOrder order, bool descending,
+                  unsigned threads) {
+    sortRows(files, rows, order, descending, threads, rows.size());
+}
+
+std::size_t writeFileList(std::ostream& out, const FileTable& files, const std::vector<std::uint32_t>& selection,
+                          const ListOptions& options) {
+    if (options.offset >= selection.size()) {
+        return 0;
+    }
+    std::size_t end = selection.size();
+    if (options.limit > 0) {
+        end = options.offset + std::min(options.limit, end - options.offset);
+    }
+
+    std::vector<std::uint32_t> sorted;
+    const std::vector<std::uint32_t>* rows = &selection;
+    if (options.order != ListOrder::Table || options.descending) {
+        sorted = selection;
+        sortRows(files, sorted, options.order, options.descending, options.threads, end);
+        rows = &sorted;
+    }
+
+    // Directory prefixes ("dir/") are built the first time a directory is listed, only for
+    // the directories on this page.
+    std::unordered_map<std::uint32_t, std::string> prefixes;
+
+    LineWriter writer(out);
+    for (std::size_t i = options.offset; i < end; ++i) {
+        std::uint32_t row = (*rows)[i];
+        auto [it, added] = prefixes.try_emplace(files.directoryId(row));
+        std::string& prefix = it->second;
+        if (added) {
+            prefix = files.directoryPath(it->first).string();
+            if (!prefix.empty() && prefix.back() != static_cast<char>(fs::path::preferred_separator) && prefix.back() != '/') {
+                prefix += static_cast<char>(fs::path::preferred_separator);
+            }
+        }
+
+        writer.append(prefix);
+        writer.append(files.name(row));
+        writer.append(" | ");
+        writer.append(files.fileSize(row));
+        writer.append(" bytes | ");
+        writer.append(files.extension(row));
+        writer.endLine();
+    }
+    return end - options.offset;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+class FileTable;
+
+enum class ListOrder : std::uint8_t {
+    Table,      // row order, i.e. as scanned
+    Size,
+    Name,       // leaf name, byte-wise
+    Extension   // then leaf name
+};
+
+struct ListOptions {
+    ListOrder order = ListOrder::Table;
+    bool descending = false;
+    // Page: rows [offset, offset + limit) of the sorted list; limit 0 means to the end.
+    std::size_t offset = 0;
+    std::size_t limit = 0;
+    // Sorting threads; 0 uses std::thread::hardware_concurrency().
+    unsigned threads = 0;
+};
+
+// Sorts FileTable rows in place. Ties are broken by row, so the order is deterministic and
+// Table order is the identity. Large selections are sorted in chunks on several threads and
+// merged pairwise; only the 4-byte rows move, never paths.
+void sortFileRows(const FileTable& files, std::vector<std::uint32_t>& rows, ListOrder order, bool descending = false,
+                  unsigned threads = 0);
+
+// Writes one "path | size bytes | extension" line per row of the requested page of
+// `selection` (listed as given for ascending Table order). Lines are formatted into a reusable
+// 1 MiB buffer, with each directory path built once, and handed to `out` one buffer at a time.
+// Returns the number of lines.
+std::size_t writeFileList(std::ostream& out, const FileTable& files, const std::vector<std::uint32_t>& selection,
+                          const ListOptions& options = {});
@@ -0,0 +1,168 @@
+#include "file_table.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace fs = std::filesystem;
+
+std::string_view extensionOf(std::string_view name) {
+    if (name == "." || name == "..") {
+        return {};
+    }
+    std::size_t dot = name.rfind('.');
+    if (dot == std::string_view::npos || dot == 0) {
+        return {};
+    }
+    return name.substr(dot);
+}
+
+std::string_view FileTable::name(std::size_t i) const {
+    return std::string_view(m_names.data() + m_fileNameOffsets[i], m_fileNameLengths[i]);
+}
+
+std::string_view FileTable::directoryName(std::uint32_t dir) const {
+    return std::string_view(m_names.data() + m_dirNameOffsets[dir], m_dirNameLengths[dir]);
+}
+
+fs::path FileTable::directoryPath(std::uint32_t dir) const {
+    std::vector<std::uint32_t> chain;
+    for (std::uint32_t d = dir; d != kNoParent; d = m_dirParents[d]) {
+        chain.push_back(d);
+    }
+
+    fs::path p;
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        p /= fs::path(directoryName(*it));
+    }
+    return p;
+}
+
+fs::path FileTable::path(std::size_t i) const {
+    return directoryPath(m_fileDirs[i]) / fs::path(name(i));
+}
+
+FileInfo FileTable::info(std::size_t i) const {
+    FileInfo f;
+    f.path = path(i);
+    f.size = m_sizes[i];
+    f.extension = std::string(extension(i));
+    return f;
+}
+
+std::uint32_t FileTable::addDirectory(std::uint32_t parent, std::string_view name,
+                                      const DirStamp& stamp, std::uint32_t position) {
+    auto id = static_cast<std::uint32_t>(m_dirParents.size());
+    m_dirParents.push_back(parent);
+    m_dirNameOffsets.push_back(m_names.size());
+    m_dirNameLengths.push_back(static_cast<std::uint32_t>(name.size()));
+    m_dirStamps.push_back(stamp);
+    m_dirPositions.push_back(position);
+    m_names.append(name.data(), name.size());
+    return id;
+}
+
+std::uint32_t FileTable::internExtension(std::string_view ext) {
+    char lower[32];
+    std::string folded;
+    std::string_view key = ext;
+    if (ext.size() <= sizeof(lower)) {
+        std::ranges::transform(ext, lower,
+                               [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        key = std::string_view(lower, ext.size());
+    } else {
+        folded.assign(ext);
+        std::ranges::transform(folded, folded.begin(),
+                               [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        key = folded;
+    }
+
+    if (auto it = m_extIndex.find(key); it != m_extIndex.end()) {
+        return it->second;
+    }
+
+    auto id = static_cast<std::uint32_t>(m_extensions.size());
+    m_extensions.emplace_back(key);
+    m_extCategories.push_back(classifyExtension(key));
+    m_extIndex.emplace(m_extensions.back(), id);
+    return id;
+}
+
+void FileTable::addFile(std::uint32_t dir, std::string_view name, std::uint64_t size) {
+    std::uint32_t ext = internExtension(extensionOf(name));
+
+    m_fileDirs.push_back(dir);
+    m_fileNameOffsets.push_back(m_names.size());
+    m_fileNameLengths.push_back(static_cast<std::uint32_t>(name.size()));
+    m_names.append(name.data(), name.size());
+    m_sizes.push_back(size);
+    m_extIds.push_back(ext);
+    m_categories.push_back(m_extCategories[ext]);
+}
+
+template <typename T>
+static void appendShifted(Column<T>& to, const Column<T>& from, T shift) {
+    to.reserve(to.size() + from.size());
+    for (std::size_t i = 0; i < from.size(); ++i) {
+        to.push_back(from[i] + shift);
+    }
+}
+
+void FileTable::append(const FileTable& other) {
+    const auto dirBase = static_cast<std::uint32_t>(directoryCount());
+    const std::uint64_t nameBase = m_names.size();
+
+    std::vector<std::uint32_t> extIds(other.m_extensions.size());
+    for (std::size_t e = 0; e < extIds.size(); ++e) {
+        extIds[e] = internExtension(other.m_extensions[e]);
+    }
+
+    m_names.append(other.m_names.data(), other.m_names.size());
+
+    m_dirParents.reserve(m_dirParents.size() + other.m_dirParents.size());
+    for (std::size_t d = 0; d < other.m_dirParents.size(); ++d) {
+        std::uint32_t parent = other.m_dirParents[d];
+        m_dirParents.push_back(parent == kNoParent ? kNoParent : parent + dirBase);
+    }
+    appendShifted(m_dirNameOffsets, other.m_dirNameOffsets, nameBase);
+    m_dirNameLengths.append(other.m_dirNameLengths.data(), other.m_dirNameLengths.size());
+    m_dirStamps.append(other.m_dirStamps.data(), other.m_dirStamps.size());
+    m_dirPositions.append(other.m_dirPositions.data(), other.m_dirPositions.size());
+
+    reserve(size() + other.size());
+    appendShifted(m_fileDirs, other.m_fileDirs, dirBase);
+    appendShifted(m_fileNameOffsets, other.m_fileNameOffsets, nameBase);
+    m_fileNameLengths.append(other.m_fileNameLengths.data(), other.m_fileNameLengths.size());
+    m_sizes.append(other.m_sizes.data(), other.m_sizes.size());
+    for (std::size_t i = 0; i < other.size(); ++i) {
+        m_extIds.push_back(extIds[other.m_extIds[i]]);
+    }
+    m_categories.append(other.m_categories.data(), other.m_categories.size());
+}
+
+void FileTable::reserve(std::size_t files) {
+    m_fileDirs.reserve(files);
+    m_fileNameOffsets.reserve(files);
+    m_fileNameLengths.reserve(files);
+    m_sizes.reserve(files);
+    m_extIds.reserve(files);
+    m_categories.reserve(files);
+}
+
+std::size_t FileTable::memoryUsage() const {
+    std::size_t bytes = m_names.capacity();
+    bytes += m_fileDirs.capacity() * sizeof(std::uint32_t);
+    bytes += m_fileNameOffsets.capacity() * sizeof(std::uint64_t);
+    bytes += m_fileNameLengths.capacity() * sizeof(std::uint32_t);
+    bytes += m_sizes.capacity() * sizeof(std::uint64_t);
+    bytes += m_extIds.capacity() * sizeof(std::uint32_t);
+    bytes += m_categories.capacity() * sizeof(FileCategory);
+    bytes += m_dirParents.capacity() * sizeof(std::uint32_t);
+    bytes += m_dirNameOffsets.capacity() * sizeof(std::uint64_t);
+    bytes += m_dirNameLengths.capacity() * sizeof(std::uint32_t);
+    bytes += m_dirStamps.capacity() * sizeof(DirStamp);
+    bytes += m_dirPositions.capacity() * sizeof(std::uint32_t);
+    for (const auto& e : m_extensions) {
+        bytes += sizeof(e) + e.capacity();
+    }
+    return bytes;
+}
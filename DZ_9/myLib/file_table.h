@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct FileInfo {
+    std::filesystem::path path;
+    std::uint64_t size = 0;
+    std::string extension;
+};
+
+enum class FileCategory : std::uint8_t {
+    Text,
+    Image,
+    Executable,
+    Other
+};
+
+// Identity and modification time of a directory at the moment it was listed. Used to decide
+// whether a directory can be taken from a previous scan instead of being read again.
+struct DirStamp {
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    std::int64_t mtimeNs = 0;
+
+    bool valid() const { return mtimeNs != 0 || inode != 0; }
+    bool operator==(const DirStamp&) const = default;
+};
+
+// Extension of a leaf name with std::filesystem::path::extension() semantics ("" for ".bashrc").
+std::string_view extensionOf(std::string_view name);
+
+// Built-in categories; `ext` may be in any case, e.g. ".PNG" or ".png".
+FileCategory classifyExtension(std::string_view ext);
+
+// Column storage for FileTable. It either owns its elements or points into memory owned by
+// someone else (a mapped index file); the first modification of a borrowed column copies it.
+template <typename T>
+class Column {
+public:
+    Column() = default;
+
+    explicit Column(std::vector<T> values)
+        : m_owned(std::move(values))
+    {
+        sync();
+    }
+
+    Column(const Column& other) { *this = other; }
+    Column(Column&& other) noexcept { *this = std::move(other); }
+
+    Column& operator=(const Column& other) {
+        if (this != &other) {
+            m_owned = other.m_owned;
+            m_borrowed = other.m_borrowed;
+            m_data = m_borrowed ? other.m_data : m_owned.data();
+            m_size = other.m_size;
+        }
+        return *this;
+    }
+
+    Column& operator=(Column&& other) noexcept {
+        if (this != &other) {
+            m_owned = std::move(other.m_owned);
+            m_borrowed = other.m_borrowed;
+            m_data = m_borrowed ? other.m_data : m_owned.data();
+            m_size = other.m_size;
+            other.m_owned.clear();
+            other.m_borrowed = false;
+            other.m_data = nullptr;
+            other.m_size = 0;
+        }
+        return *this;
+    }
+
+    void borrow(const T* data, std::size_t size) {
+        m_owned = {};
+        m_borrowed = true;
+        m_data = data;
+        m_size = size;
+    }
+
+    const T& operator[](std::size_t i) const { return m_data[i]; }
+    const T* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    std::size_t capacity() const { return m_borrowed ? 0 : m_owned.capacity(); }
+    operator std::span<const T>() const { return {m_data, m_size}; }
+
+    void push_back(const T& value) {
+        detach();
+        m_owned.push_back(value);
+        sync();
+    }
+
+    void append(const T* first, std::size_t count) {
+        detach();
+        m_owned.insert(m_owned.end(), first, first + count);
+        sync();
+    }
+
+    void reserve(std::size_t n) {
+        detach();
+        m_owned.reserve(n);
+        sync();
+    }
+
+private:
+    void detach() {
+        if (m_borrowed) {
+            m_owned.assign(m_data, m_data + m_size);
+            m_borrowed = false;
+        }
+    }
+
+    void sync() {
+        m_data = m_owned.data();
+        m_size = m_owned.size();
+    }
+
+    std::vector<T> m_owned;
+    bool m_borrowed = false;
+    const T* m_data = nullptr;
+    std::size_t m_size = 0;
+};
+
+// Struct-of-arrays store for scan results. Every file is a row across fixed-width columns;
+// file and directory leaf names share one string arena, directories are (parent, name) pairs
+// and extensions are interned, so a row costs ~30 bytes plus its name.
+class FileTable {
+public:
+    static constexpr std::uint32_t kNoParent = 0xFFFFFFFFu;
+
+    std::size_t size() const { return m_sizes.size(); }
+    bool empty() const { return m_sizes.empty(); }
+
+    std::uint64_t fileSize(std::size_t i) const { return m_sizes[i]; }
+    FileCategory category(std::size_t i) const { return m_categories[i]; }
+    std::uint32_t directoryId(std::size_t i) const { return m_fileDirs[i]; }
+    std::uint32_t extensionId(std::size_t i) const { return m_extIds[i]; }
+    std::string_view name(std::size_t i) const;
+    std::string_view extension(std::size_t i) const { return m_extensions[m_extIds[i]]; }
+    std::filesystem::path path(std::size_t i) const;
+    FileInfo info(std::size_t i) const;
+
+    std::size_t directoryCount() const { return m_dirParents.size(); }
+    std::uint32_t directoryParent(std::uint32_t dir) const { return m_dirParents[dir]; }
+    std::string_view directoryName(std::uint32_t dir) const;
+    std::filesystem::path directoryPath(std::uint32_t dir) const;
+    const DirStamp& directoryStamp(std::uint32_t dir) const { return m_dirStamps[dir]; }
+    // Number of the parent's files that were listed before this directory.
+    std::uint32_t directoryPosition(std::uint32_t dir) const { return m_dirPositions[dir]; }
+
+    std::size_t extensionCount() const { return m_extensions.size(); }
+    std::string_view extensionName(std::uint32_t id) const { return m_extensions[id]; }
+
+    std::span<const std::uint64_t> sizes() const { return m_sizes; }
+    std::span<const FileCategory> categories() const { return m_categories; }
+    std::span<const std::uint32_t> extensionIds() const { return m_extIds; }
+    std::span<const std::uint32_t> directoryIds() const { return m_fileDirs; }
+
+    // Roots are added with kNoParent and their full path as the name.
+    std::uint32_t addDirectory(std::uint32_t parent, std::string_view name,
+                               const DirStamp& stamp = {}, std::uint32_t position = 0);
+    void addFile(std::uint32_t dir, std::string_view name, std::uint64_t size);
+    // Adds all rows and directories of `other` after this table's, its roots as further roots.
+    void append(const FileTable& other);
+    void reserve(std::size_t files);
+
+    std::size_t memoryUsage() const;
+
+private:
+    friend class ScanIndexIO;
+
+    struct StringHash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+
+    std::uint32_t internExtension(std::string_view ext);
+
+    // Keeps a mapped index alive while any column still borrows from it.
+    std::shared_ptr<const void> m_mapping;
+
+    Column<char> m_names;
+
+    Column<std::uint32_t> m_fileDirs;
+    Column<std::uint64_t> m_fileNameOffsets;
+    Column<std::uint32_t> m_fileNameLengths;
+    Column<std::uint64_t> m_sizes;
+    Column<std::uint32_t> m_extIds;
+    Column<FileCategory> m_categories;
+
+    Column<std::uint32_t> m_dirParents;
+    Column<std::uint64_t> m_dirNameOffsets;
+    Column<std::uint32_t> m_dirNameLengths;
+    Column<DirStamp> m_dirStamps;
+    Column<std::uint32_t> m_dirPositions;
+
+    std::vector<std::string> m_extensions;
+    std::vector<FileCategory> m_extCategories;
+    std::unordered_map<std::string, std::uint32_t, StringHash, std::equal_to<>> m_extIndex;
+};
@@ -1,11 +1,34 @@
 #include "mylib.h"
+#include "uring_stat.h"
+#include "extension_classifier.h"
 
 #include <iostream>
 #include <ranges>
-#include <unordered_set>
 #include <algorithm>
+#include <bit>
+#include <chrono>
+#include <ctime>
 #include <cctype>
 #include <system_error>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif
+
+#if defined(__linux__)
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace fs = std::filesystem;
 
@@ -14,102 +37,1087 @@ static void normalizeExtension(std::string& ext) {
                            [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
 }
 
-static bool isImageExt(const std::string& ext) {
-    static const std::unordered_set<std::string> exts{
-        ".jpg", ".jpeg", ".png", ".bmp", ".gif", ".tiff"
-    };
-    return exts.contains(ext);
+static constexpr auto kBuiltinExtensions = makeStaticExtensionTable<4>(
+    {
+        {"txt", static_cast<std::uint16_t>(FileCategory::Text)},
+        {"jpg", static_cast<std::uint16_t>(FileCategory::Image)},
+        {"jpeg", static_cast<std::uint16_t>(FileCategory::Image)},
+        {"png", static_cast<std::uint16_t>(FileCategory::Image)},
+        {"bmp", static_cast<std::uint16_t>(FileCategory::Image)},
+        {"gif", static_cast<std::uint16_t>(FileCategory::Image)},
+        {"tiff", static_cast<std::uint16_t>(FileCategory::Image)},
+        {"exe", static_cast<std::uint16_t>(FileCategory::Executable)},
+    },
+    static_cast<std::uint16_t>(FileCategory::Other));
+
+static_assert(kBuiltinExtensions.lookup(".JPG") == static_cast<std::uint16_t>(FileCategory::Image));
+static_assert(kBuiltinExtensions.lookup(".tif") == static_cast<std::uint16_t>(FileCategory::Other));
+
+FileCategory classifyExtension(std::string_view ext) {
+    return static_cast<FileCategory>(kBuiltinExtensions.lookup(ext));
 }
 
-static void addToCategory(ScanResult& r, const FileInfo& f) {
+static std::size_t sizeBucket(std::uint64_t size) {
+    return static_cast<std::size_t>(std::bit_width(size));
+}
+
+static void addStats(CategoryStats& s, std::uint64_t size) {
+    ++s.count;
+    s.bytes += size;
+    ++s.histogram[sizeBucket(size)];
+}
+
+static void mergeStats(CategoryStats& into, const CategoryStats& from) {
+    into.count += from.count;
+    into.bytes += from.bytes;
+    for (std::size_t b = 0; b < kSizeBuckets; ++b) {
+        into.histogram[b] += from.histogram[b];
+    }
+}
+
+static CategoryStats& statsOf(ScanResult& r, FileCategory category) {
+    switch (category) {
+        case FileCategory::Text: return r.txt;
+        case FileCategory::Image: return r.images;
+        case FileCategory::Executable: return r.exe;
+        case FileCategory::Other: break;
+    }
+    return r.other;
+}
+
+static void addToCategory(ScanResult& r, FileCategory category, std::uint64_t size) {
     ++r.totalFiles;
-    r.totalBytes += f.size;
+    r.totalBytes += size;
+    addStats(statsOf(r, category), size);
+}
 
-    if (f.extension == ".txt") {
-        ++r.txt.count;
-        r.txt.bytes += f.size;
-        return;
+static void addToCategory(ScanResult& r, const CategoryMatcher* matcher, std::string_view name, std::uint64_t size) {
+    if (matcher) {
+        addStats(r.categories[matcher->match(name, size)], size);
     }
+}
 
-    if (isImageExt(f.extension)) {
-        ++r.images.count;
-        r.images.bytes += f.size;
-        return;
+// Heap order for ScanResult::largest: bigger first, then by path so the result does not depend
+// on the order in which threads reach the files.
+static bool largerFile(const LargeFile& a, const LargeFile& b) {
+    if (a.size != b.size) {
+        return a.size > b.size;
     }
+    return a.path < b.path;
+}
 
-    if (f.extension == ".exe") {
-        ++r.exe.count;
-        r.exe.bytes += f.size;
+// `heap` is a heap under largerFile, so its front is the smallest of the files kept. The path
+// is only built for files that make it in.
+template <typename MakePath>
+static void offerLargeFile(std::vector<LargeFile>& heap, std::size_t limit, std::uint64_t size, MakePath makePath) {
+    if (limit == 0 || (heap.size() == limit && size < heap.front().size)) {
         return;
     }
+    LargeFile f{makePath(), size};
+    if (heap.size() < limit) {
+        heap.push_back(std::move(f));
+        std::ranges::push_heap(heap, largerFile);
+    } else if (largerFile(f, heap.front())) {
+        std::ranges::pop_heap(heap, largerFile);
+        heap.back() = std::move(f);
+        std::ranges::push_heap(heap, largerFile);
+    }
+}
 
-    ++r.other.count;
-    r.other.bytes += f.size;
+static void finishLargest(std::vector<LargeFile>& files, std::size_t limit) {
+    std::ranges::sort(files, largerFile);
+    if (files.size() > limit) {
+        files.resize(limit);
+    }
 }
 
-ScanResult scanDirectoryRecursive(const fs::path& root) {
-    ScanResult r;
+namespace {
 
+// One directory of the tree. Files keep readdir order; every child remembers how many
+// files were listed before it so the serial pre-order can be rebuilt after a parallel walk.
+struct DirNode {
+    fs::path path;
+    DirStamp stamp;
+    std::uint32_t previous = FileTable::kNoParent;
+    std::string names;
+    std::vector<std::uint32_t> nameEnds;
+    std::vector<std::uint64_t> sizes;
+    std::vector<std::pair<std::size_t, DirNode*>> children;
+
+    // Subtree totals, rolled up by the walker: `outstanding` counts this node's own listing
+    // plus each child whose subtree is not finished yet. Whoever drops it to zero adds the
+    // totals into the parent, so the roll-up runs bottom-up on all workers during the walk.
+    DirNode* parent = nullptr;
+    std::atomic<std::uint32_t> outstanding{1};
+    std::atomic<std::uint64_t> treeBytes{0};
+    std::atomic<std::uint64_t> treeFiles{0};
+};
+
+DirStamp readDirStamp(const fs::path& dir) {
+    DirStamp stamp;
+#if defined(_WIN32)
     std::error_code ec;
-    r.inputPathValid = fs::exists(root, ec) && fs::is_directory(root, ec);
-    if (!r.inputPathValid) {
-        return r;
+    auto t = fs::last_write_time(dir, ec);
+    if (!ec) {
+        stamp.mtimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
     }
+#else
+    struct stat st {};
+    if (::stat(dir.c_str(), &st) == 0) {
+        stamp.device = static_cast<std::uint64_t>(st.st_dev);
+        stamp.inode = static_cast<std::uint64_t>(st.st_ino);
+#if defined(__APPLE__)
+        stamp.mtimeNs = static_cast<std::int64_t>(st.st_mtimespec.tv_sec) * 1'000'000'000 + st.st_mtimespec.tv_nsec;
+#else
+        stamp.mtimeNs = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+#endif
+    }
+#endif
+    return stamp;
+}
 
-    fs::recursive_directory_iterator it(
-        root,
-        fs::directory_options::skip_permission_denied,
-        ec
-    );
+// Now, on the clock readDirStamp's mtimes come from.
+std::int64_t stampClockNowNs() {
+#if defined(_WIN32)
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        fs::file_time_type::clock::now().time_since_epoch()).count();
+#else
+    timespec ts {};
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<std::int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+#endif
+}
 
-    if (ec) {
-        return r;
+// Directory mtimes are coarser than the clock (a jiffy, up to two seconds on FAT), so a
+// directory changed in the same tick as the scan that listed it can keep the mtime of the
+// listing. Stamps this close to the scan start are not recorded, as git does for racily
+// clean index entries; the next scan lists such a directory again and records it then.
+constexpr std::int64_t kRacyStampNs = 2'000'000'000;
+
+// Per-directory lookup over the table of a previous scan: the direct files and subdirectories
+// of every directory (CSR layout), with subdirectories also sorted by name for matching.
+class PreviousTree {
+    const FileTable& m_table;
+    std::vector<std::uint32_t> m_fileBegin;
+    std::vector<std::uint32_t> m_fileRows;
+    std::vector<std::uint32_t> m_childBegin;
+    std::vector<std::uint32_t> m_children;
+    std::vector<std::uint32_t> m_childrenByName;
+
+public:
+    explicit PreviousTree(const FileTable& table)
+        : m_table(table)
+    {
+        const std::size_t dirs = table.directoryCount();
+
+        m_fileBegin.assign(dirs + 1, 0);
+        for (std::uint32_t d : table.directoryIds()) {
+            ++m_fileBegin[d + 1];
+        }
+        m_childBegin.assign(dirs + 1, 0);
+        for (std::uint32_t d = 0; d < dirs; ++d) {
+            if (table.directoryParent(d) != FileTable::kNoParent) {
+                ++m_childBegin[table.directoryParent(d) + 1];
+            }
+        }
+        for (std::size_t d = 0; d < dirs; ++d) {
+            m_fileBegin[d + 1] += m_fileBegin[d];
+            m_childBegin[d + 1] += m_childBegin[d];
+        }
+
+        std::vector<std::uint32_t> fill(m_fileBegin.begin(), m_fileBegin.end() - 1);
+        m_fileRows.resize(table.size());
+        for (std::size_t i = 0; i < table.size(); ++i) {
+            m_fileRows[fill[table.directoryId(i)]++] = static_cast<std::uint32_t>(i);
+        }
+
+        fill.assign(m_childBegin.begin(), m_childBegin.end() - 1);
+        m_children.resize(m_childBegin.back());
+        for (std::uint32_t d = 0; d < dirs; ++d) {
+            if (table.directoryParent(d) != FileTable::kNoParent) {
+                m_children[fill[table.directoryParent(d)]++] = d;
+            }
+        }
+
+        m_childrenByName = m_children;
+        for (std::size_t d = 0; d < dirs; ++d) {
+            std::sort(m_childrenByName.begin() + m_childBegin[d], m_childrenByName.begin() + m_childBegin[d + 1],
+                      [&](std::uint32_t a, std::uint32_t b) { return table.directoryName(a) < table.directoryName(b); });
+        }
+    }
+
+    const FileTable& table() const { return m_table; }
+
+    std::span<const std::uint32_t> files(std::uint32_t dir) const {
+        return std::span(m_fileRows).subspan(m_fileBegin[dir], m_fileBegin[dir + 1] - m_fileBegin[dir]);
+    }
+
+    std::span<const std::uint32_t> children(std::uint32_t dir) const {
+        return std::span(m_children).subspan(m_childBegin[dir], m_childBegin[dir + 1] - m_childBegin[dir]);
+    }
+
+    std::uint32_t findRoot(std::string_view name) const {
+        for (std::uint32_t d = 0; d < m_table.directoryCount(); ++d) {
+            if (m_table.directoryParent(d) == FileTable::kNoParent && m_table.directoryName(d) == name) {
+                return d;
+            }
+        }
+        return FileTable::kNoParent;
+    }
+
+    std::uint32_t findChild(std::uint32_t dir, std::string_view name) const {
+        auto first = m_childrenByName.begin() + m_childBegin[dir];
+        auto last = m_childrenByName.begin() + m_childBegin[dir + 1];
+        auto it = std::lower_bound(first, last, name,
+                                   [&](std::uint32_t d, std::string_view n) { return m_table.directoryName(d) < n; });
+        if (it != last && m_table.directoryName(*it) == name) {
+            return *it;
+        }
+        return FileTable::kNoParent;
+    }
+};
+
+#if defined(__linux__)
+// A getdents64 entry waiting for its stat; the name lives NUL-terminated in a worker arena.
+struct PendingEntry {
+    std::uint32_t nameOffset;
+    std::uint32_t nameLength;
+    unsigned char type;
+    std::uint32_t request;
+};
+
+constexpr std::uint32_t kNoRequest = 0xFFFFFFFFu;
+#endif
+
+class DirWalker {
+    struct Worker {
+        std::mutex mutex;
+        std::deque<DirNode*> tasks;
+        std::deque<DirNode> nodes;
+        ScanResult partial;
+        FileInfo scratch;
+        std::string name;
+        std::vector<std::uint64_t> dirents;
+        // Null unless the scan reports progress; `timing` is the same slot when timing is on.
+        ScanProgress::Slot* progress = nullptr;
+        ScanProgress::Slot* timing = nullptr;
+#if defined(__linux__)
+        std::vector<PendingEntry> pending;
+        std::string pendingNames;
+        std::vector<StatxRequest> statRequests;
+        std::unique_ptr<StatxRing> ring;
+        bool ringUnavailable = false;
+#endif
+    };
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    const FileVisitor* m_visitor = nullptr;
+    const CategoryMatcher* m_categories = nullptr;
+    std::size_t m_largestFiles = 0;
+    ScanProgress* m_progress = nullptr;
+    const PreviousTree* m_previous = nullptr;
+    std::int64_t m_scanStartNs = stampClockNowNs();
+    ScanBackend m_backend = ScanBackend::StdFilesystem;
+    std::vector<DirNode*> m_roots;
+    std::atomic<std::size_t> m_pending{0};
+    std::atomic<std::size_t> m_queued{0};
+    std::mutex m_idleMutex;
+    std::condition_variable m_idleCv;
+
+public:
+    // With a visitor the walker streams: files are handed to it instead of being stored and
+    // directory nodes are released as soon as they have been listed.
+    // With a previous tree, directories whose stamp is unchanged are copied from it.
+    DirWalker(const ScanOptions& options, unsigned threads, ScanBackend backend, const FileVisitor* visitor,
+              const PreviousTree* previous)
+        : m_visitor(visitor), m_categories(options.categories), m_largestFiles(options.largestFiles),
+          m_progress(options.progress), m_previous(previous), m_backend(backend)
+    {
+        if (m_progress) {
+            m_progress->begin(threads);
+        }
+        for (unsigned i = 0; i < threads; ++i) {
+            Worker& w = *m_workers.emplace_back(std::make_unique<Worker>());
+            if (m_categories) {
+                w.partial.categories.resize(m_categories->categoryCount());
+            }
+            if (m_progress) {
+                w.progress = &m_progress->slot(i);
+                w.timing = m_progress->timing() ? w.progress : nullptr;
+            }
+        }
+    }
+
+    ~DirWalker() {
+        if (m_progress) {
+            m_progress->finish();
+        }
+    }
+
+    // Several roots are walked as one job: they start on different workers and are balanced
+    // by stealing like any other subtree.
+    void run(std::span<DirNode* const> roots) {
+        m_roots.assign(roots.begin(), roots.end());
+        for (std::size_t i = 0; i < roots.size(); ++i) {
+            push(i % m_workers.size(), roots[i]);
+        }
+        runWorkers();
+    }
+
+    void run(DirNode& root) {
+        DirNode* roots[] = {&root};
+        run(roots);
+    }
+
+    void mergeInto(ScanResult& r) const {
+        for (const auto& w : m_workers) {
+            const ScanResult& p = w->partial;
+            mergeStats(r.txt, p.txt);
+            mergeStats(r.images, p.images);
+            mergeStats(r.exe, p.exe);
+            mergeStats(r.other, p.other);
+            r.totalFiles += p.totalFiles;
+            r.totalBytes += p.totalBytes;
+            r.skippedEntries += p.skippedEntries;
+            r.reusedDirectories += p.reusedDirectories;
+
+            r.categories.resize(p.categories.size());
+            for (std::size_t i = 0; i < p.categories.size(); ++i) {
+                mergeStats(r.categories[i], p.categories[i]);
+            }
+            r.largest.insert(r.largest.end(), p.largest.begin(), p.largest.end());
+        }
+        finishLargest(r.largest, m_largestFiles);
+        if (m_categories) {
+            r.categoryNames = m_categories->categoryNames();
+        }
+    }
+
+private:
+    void runWorkers() {
+        std::vector<std::thread> threads;
+        for (std::size_t i = 1; i < m_workers.size(); ++i) {
+            threads.emplace_back([this, i] { workerLoop(i); });
+        }
+        workerLoop(0);
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+    bool isRoot(const DirNode& node) const {
+        return std::find(m_roots.begin(), m_roots.end(), &node) != m_roots.end();
+    }
+
+    void push(std::size_t self, DirNode* node) {
+        ++m_pending;
+        {
+            std::lock_guard lock(m_workers[self]->mutex);
+            m_workers[self]->tasks.push_back(node);
+        }
+        ++m_queued;
+        if (m_workers.size() > 1) {
+            std::lock_guard lock(m_idleMutex);
+            m_idleCv.notify_one();
+        }
+    }
+
+    // Own deque is used LIFO to stay depth-first; thieves take the oldest (usually largest) subtree.
+    DirNode* take(std::size_t self) {
+        const std::size_t n = m_workers.size();
+        for (std::size_t k = 0; k < n; ++k) {
+            Worker& w = *m_workers[(self + k) % n];
+            std::lock_guard lock(w.mutex);
+            if (w.tasks.empty()) {
+                continue;
+            }
+            DirNode* node = nullptr;
+            if (k == 0) {
+                node = w.tasks.back();
+                w.tasks.pop_back();
+            } else {
+                node = w.tasks.front();
+                w.tasks.pop_front();
+            }
+            --m_queued;
+            return node;
+        }
+        return nullptr;
+    }
+
+    void workerLoop(std::size_t self) {
+        for (;;) {
+            if (DirNode* node = take(self)) {
+                listDirectory(self, *node);
+                if (m_visitor) {
+                    if (!isRoot(*node)) {
+                        delete node;
+                    }
+                } else {
+                    rollUp(*node);
+                }
+                if (--m_pending == 0) {
+                    std::lock_guard lock(m_idleMutex);
+                    m_idleCv.notify_all();
+                }
+                continue;
+            }
+
+            std::unique_lock lock(m_idleMutex);
+            m_idleCv.wait(lock, [this] { return m_queued > 0 || m_pending == 0; });
+            if (m_pending == 0) {
+                return;
+            }
+        }
+    }
+
+    void addChild(std::size_t self, DirNode& parent, fs::path path, std::uint32_t previous) {
+        if (m_visitor) {
+            auto child = std::make_unique<DirNode>();
+            child->path = std::move(path);
+            child->previous = previous;
+            push(self, child.release());
+        } else {
+            DirNode& child = m_workers[self]->nodes.emplace_back();
+            child.path = std::move(path);
+            child.previous = previous;
+            child.parent = &parent;
+            parent.outstanding.fetch_add(1, std::memory_order_relaxed);
+            parent.children.emplace_back(parent.sizes.size(), &child);
+            push(self, &child);
+        }
+    }
+
+    void rollUp(DirNode& node) {
+        std::uint64_t bytes = 0;
+        for (std::uint64_t size : node.sizes) {
+            bytes += size;
+        }
+        node.treeBytes.fetch_add(bytes, std::memory_order_relaxed);
+        node.treeFiles.fetch_add(node.sizes.size(), std::memory_order_relaxed);
+
+        for (DirNode* n = &node; n && n->outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1; n = n->parent) {
+            if (n->parent) {
+                n->parent->treeBytes.fetch_add(n->treeBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                n->parent->treeFiles.fetch_add(n->treeFiles.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+        }
     }
 
-    for (const auto& entry : it) {
+    // Replays the listing recorded in the previous scan. Subdirectories are still queued so
+    // that each of them gets its own stamp check.
+    void reuseDirectory(std::size_t self, DirNode& node) {
+        Worker& w = *m_workers[self];
+        const FileTable& t = m_previous->table();
+        std::span<const std::uint32_t> rows = m_previous->files(node.previous);
+        std::span<const std::uint32_t> kids = m_previous->children(node.previous);
+
+        std::size_t k = 0;
+        for (std::size_t f = 0; f <= rows.size(); ++f) {
+            while (k < kids.size() && (t.directoryPosition(kids[k]) <= f || f == rows.size())) {
+                addChild(self, node, node.path / fs::path(t.directoryName(kids[k])), kids[k]);
+                ++k;
+            }
+            if (f == rows.size()) {
+                break;
+            }
+
+            std::uint32_t row = rows[f];
+            std::uint64_t size = t.fileSize(row);
+            {
+                ScanTimer timer(w.timing, ScanProgress::ClassifyNs);
+                addToCategory(w.partial, t.category(row), size);
+                addToCategory(w.partial, m_categories, t.name(row), size);
+                offerLargeFile(w.partial.largest, m_largestFiles, size, [&] { return node.path / fs::path(t.name(row)); });
+            }
+            if (w.progress) {
+                w.progress->add(ScanProgress::Files);
+                w.progress->add(ScanProgress::Bytes, size);
+            }
+
+            if (m_visitor) {
+                if (*m_visitor) {
+                    FileInfo& info = w.scratch;
+                    info.path = node.path / fs::path(t.name(row));
+                    info.size = size;
+                    info.extension = t.extension(row);
+                    (*m_visitor)(info);
+                }
+                continue;
+            }
+
+            node.names.append(t.name(row));
+            node.nameEnds.push_back(static_cast<std::uint32_t>(node.names.size()));
+            node.sizes.push_back(size);
+        }
+
+        ++w.partial.reusedDirectories;
+        if (w.progress) {
+            w.progress->add(ScanProgress::ReusedDirectories);
+        }
+    }
+
+    void listDirectory(std::size_t self, DirNode& node) {
+        if (m_previous || !m_visitor) {
+            node.stamp = readDirStamp(node.path);
+        }
+        if (m_previous) {
+            if (node.previous != FileTable::kNoParent && node.stamp.valid() &&
+                node.stamp == m_previous->table().directoryStamp(node.previous)) {
+                reuseDirectory(self, node);
+                return;
+            }
+        }
+        if (node.stamp.mtimeNs >= m_scanStartNs - kRacyStampNs) {
+            node.stamp = {};
+        }
+
+#if defined(__linux__)
+        if (m_backend == ScanBackend::Getdents || m_backend == ScanBackend::IoUring) {
+            listWithGetdents(self, node);
+            return;
+        }
+#endif
+        listWithFilesystem(self, node);
+    }
+
+    void addFile(std::size_t self, DirNode& node, std::string_view name, std::uint64_t size) {
+        Worker& w = *m_workers[self];
+        {
+            ScanTimer timer(w.timing, ScanProgress::ClassifyNs);
+            addToCategory(w.partial, classifyExtension(extensionOf(name)), size);
+            addToCategory(w.partial, m_categories, name, size);
+            offerLargeFile(w.partial.largest, m_largestFiles, size, [&] { return node.path / fs::path(name); });
+        }
+        if (w.progress) {
+            w.progress->add(ScanProgress::Files);
+            w.progress->add(ScanProgress::Bytes, size);
+        }
+
+        if (m_visitor) {
+            if (*m_visitor) {
+                FileInfo& info = w.scratch;
+                info.path = node.path / fs::path(name);
+                info.size = size;
+                info.extension = extensionOf(name);
+                normalizeExtension(info.extension);
+                (*m_visitor)(info);
+            }
+            return;
+        }
+
+        node.names.append(name);
+        node.nameEnds.push_back(static_cast<std::uint32_t>(node.names.size()));
+        node.sizes.push_back(size);
+    }
+
+    void addSubdirectory(std::size_t self, DirNode& node, std::string_view name) {
+        std::uint32_t previous = FileTable::kNoParent;
+        if (m_previous && node.previous != FileTable::kNoParent) {
+            previous = m_previous->findChild(node.previous, name);
+        }
+        addChild(self, node, node.path / fs::path(name), previous);
+    }
+
+    // Mirrors recursive_directory_iterator with skip_permission_denied: directory symlinks
+    // are not followed, unreadable subdirectories are silently skipped. A directory that could
+    // not be listed completely loses its stamp, so that the next incremental scan reads it
+    // again instead of reusing what little was found.
+    void listWithFilesystem(std::size_t self, DirNode& node) {
+        Worker& w = *m_workers[self];
+        std::error_code ec;
+
+        std::optional<ScanTimer> timer;
+        timer.emplace(w.timing, ScanProgress::SyscallNs);
+        // Opened without skip_permission_denied, which would make an unreadable directory look
+        // empty rather than failed.
+        fs::directory_iterator it(node.path, ec);
         if (ec) {
-            ++r.skippedEntries;
+            node.stamp = {};
+            if (w.progress) {
+                w.progress->addError(ec.value());
+            }
+            if (ec != std::errc::permission_denied && !isRoot(node)) {
+                ++w.partial.skippedEntries;
+            }
+            return;
+        }
+        if (w.progress) {
+            w.progress->add(ScanProgress::Directories);
+        }
+
+        for (; it != fs::directory_iterator(); it.increment(ec)) {
+            if (ec) {
+                node.stamp = {};
+                if (w.progress) {
+                    w.progress->addError(ec.value());
+                }
+                ++w.partial.skippedEntries;
+                break;
+            }
+            const fs::directory_entry& entry = *it;
+            if (w.progress) {
+                w.progress->add(ScanProgress::Entries);
+            }
+
+            if (!entry.is_symlink(ec) && entry.is_directory(ec)) {
+                timer.reset();
+                w.name = entry.path().filename().string();
+                addSubdirectory(self, node, w.name);
+                timer.emplace(w.timing, ScanProgress::SyscallNs);
+                continue;
+            }
             ec.clear();
-            continue;
+
+            if (!entry.is_regular_file(ec)) {
+                if (ec) {
+                    node.stamp = {};
+                    ec.clear();
+                }
+                continue;
+            }
+
+            if (w.progress) {
+                w.progress->add(ScanProgress::StatCalls);
+            }
+            std::uint64_t size = static_cast<std::uint64_t>(entry.file_size(ec));
+            if (ec) {
+                node.stamp = {};
+                if (w.progress) {
+                    w.progress->addError(ec.value());
+                }
+                ++w.partial.skippedEntries;
+                ec.clear();
+                continue;
+            }
+
+            timer.reset();
+            w.name = entry.path().filename().string();
+            addFile(self, node, w.name, size);
+            timer.emplace(w.timing, ScanProgress::SyscallNs);
+        }
+    }
+
+#if defined(__linux__)
+    struct LinuxDirent64 {
+        std::uint64_t d_ino;
+        std::int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    };
+
+    static constexpr std::size_t kDirentBufferBytes = 256 * 1024;
+    static constexpr unsigned kStatxRingDepth = 256;
+
+    // Stats a pending entry synchronously unless the io_uring batch already did.
+    static bool statEntry(Worker& w, int fd, StatxRequest& r, bool batched) {
+        if (!batched) {
+            ScanTimer timer(w.timing, ScanProgress::SyscallNs);
+            if (w.progress) {
+                w.progress->add(ScanProgress::StatCalls);
+            }
+            struct stat st {};
+            if (::fstatat(fd, r.name, &st, r.flags) != 0) {
+                r.result = -errno;
+            } else {
+                r.result = 0;
+                r.mode = st.st_mode;
+                r.size = static_cast<std::uint64_t>(st.st_size);
+            }
         }
+        if (r.result != 0 && w.progress) {
+            w.progress->addError(-r.result);
+        }
+        return r.result == 0;
+    }
 
-        if (!entry.is_regular_file(ec)) {
-            if (ec) ec.clear();
+    // Same decisions as listWithFilesystem, made from d_type: directories and other non-regular
+    // entries cost no stat at all, regular files one stat relative to the open directory fd.
+    // DT_UNKNOWN (some network filesystems) falls back to an lstat-style stat. The whole
+    // directory is read first; with the IoUring backend its stats are then issued as one
+    // batch with up to kStatxRingDepth requests in flight, and entries are replayed in
+    // readdir order so the result does not depend on completion order. Errors clear the stamp
+    // as in listWithFilesystem; a symlink whose target is gone is not an error.
+    void listWithGetdents(std::size_t self, DirNode& node) {
+        Worker& w = *m_workers[self];
+
+        int fd = -1;
+        {
+            ScanTimer timer(w.timing, ScanProgress::SyscallNs);
+            fd = ::open(node.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        }
+        if (fd < 0) {
+            node.stamp = {};
+            if (w.progress) {
+                w.progress->addError(errno);
+            }
+            if (errno != EACCES && !isRoot(node)) {
+                ++w.partial.skippedEntries;
+            }
+            return;
+        }
+        if (w.progress) {
+            w.progress->add(ScanProgress::Directories);
+        }
+
+        if (w.dirents.empty()) {
+            w.dirents.resize(kDirentBufferBytes / sizeof(std::uint64_t));
+        }
+        char* buffer = reinterpret_cast<char*>(w.dirents.data());
+
+        w.pending.clear();
+        w.pendingNames.clear();
+        w.statRequests.clear();
+
+        for (;;) {
+            long n = 0;
+            {
+                ScanTimer timer(w.timing, ScanProgress::SyscallNs);
+                n = ::syscall(SYS_getdents64, fd, buffer, kDirentBufferBytes);
+            }
+            if (n == 0) {
+                break;
+            }
+            if (n < 0) {
+                node.stamp = {};
+                if (w.progress) {
+                    w.progress->addError(errno);
+                }
+                ++w.partial.skippedEntries;
+                break;
+            }
+
+            for (long offset = 0; offset < n;) {
+                const auto* d = reinterpret_cast<const LinuxDirent64*>(buffer + offset);
+                offset += d->d_reclen;
+
+                std::string_view name(d->d_name);
+                if (name == "." || name == "..") {
+                    continue;
+                }
+                if (w.progress) {
+                    w.progress->add(ScanProgress::Entries);
+                }
+                unsigned char type = d->d_type;
+                if (type != DT_DIR && type != DT_REG && type != DT_LNK && type != DT_UNKNOWN) {
+                    continue;
+                }
+
+                PendingEntry e{static_cast<std::uint32_t>(w.pendingNames.size()),
+                               static_cast<std::uint32_t>(name.size()), type, kNoRequest};
+                w.pendingNames.append(name);
+                w.pendingNames.push_back('\0');
+                if (type != DT_DIR) {
+                    e.request = static_cast<std::uint32_t>(w.statRequests.size());
+                    StatxRequest& r = w.statRequests.emplace_back();
+                    r.flags = type == DT_UNKNOWN ? AT_SYMLINK_NOFOLLOW : 0;
+                }
+                w.pending.push_back(e);
+            }
+        }
+
+        for (const PendingEntry& e : w.pending) {
+            if (e.request != kNoRequest) {
+                w.statRequests[e.request].name = w.pendingNames.data() + e.nameOffset;
+            }
+        }
+
+        bool batched = false;
+        if (m_backend == ScanBackend::IoUring && !w.statRequests.empty() && !w.ringUnavailable) {
+            if (!w.ring) {
+                w.ring = std::make_unique<StatxRing>();
+                if (!w.ring->init(kStatxRingDepth)) {
+                    w.ring.reset();
+                    w.ringUnavailable = true;
+                }
+            }
+            if (w.ring) {
+                ScanTimer timer(w.timing, ScanProgress::SyscallNs);
+                batched = w.ring->run(fd, w.statRequests);
+                if (batched && w.progress) {
+                    w.progress->add(ScanProgress::StatCalls, w.statRequests.size());
+                }
+                if (!batched) {
+                    w.ring.reset();
+                    w.ringUnavailable = true;
+                }
+            }
+        }
+
+        for (const PendingEntry& e : w.pending) {
+            std::string_view name(w.pendingNames.data() + e.nameOffset, e.nameLength);
+            unsigned char type = e.type;
+
+            if (type == DT_DIR) {
+                addSubdirectory(self, node, name);
+                continue;
+            }
+
+            StatxRequest& r = w.statRequests[e.request];
+            if (type == DT_UNKNOWN) {
+                if (!statEntry(w, fd, r, batched)) {
+                    node.stamp = {};
+                    continue;
+                }
+                if (S_ISREG(r.mode)) {
+                    addFile(self, node, name, r.size);
+                    continue;
+                }
+                if (S_ISDIR(r.mode)) {
+                    addSubdirectory(self, node, name);
+                    continue;
+                }
+                if (!S_ISLNK(r.mode)) {
+                    continue;
+                }
+                type = DT_LNK;
+                r.flags = 0;
+                if (!statEntry(w, fd, r, false)) {
+                    continue;
+                }
+            } else if (!statEntry(w, fd, r, batched)) {
+                if (type == DT_REG) {
+                    node.stamp = {};
+                    ++w.partial.skippedEntries;
+                }
+                continue;
+            }
+
+            if (S_ISREG(r.mode)) {
+                addFile(self, node, name, r.size);
+            } else if (type == DT_REG) {
+                node.stamp = {};
+                ++w.partial.skippedEntries;
+            }
+        }
+
+        ScanTimer timer(w.timing, ScanProgress::SyscallNs);
+        ::close(fd);
+    }
+#endif
+};
+
+// Directory ids are handed out in pre-order as well, so a directory always follows its parent.
+// Also copies the rolled-up subtree totals; DirectoryUsage ids follow the FileTable's.
+void flattenPreorder(DirNode& root, FileTable& out, DirectoryUsage& usage) {
+    struct Frame {
+        DirNode* node;
+        std::uint32_t dir;
+        std::size_t file = 0;
+        std::size_t child = 0;
+    };
+
+    auto addUsage = [&](const DirNode& n, std::uint32_t depth) {
+        std::uint32_t id = usage.add(depth);
+        usage.setTotals(id, n.treeBytes.load(std::memory_order_relaxed), n.treeFiles.load(std::memory_order_relaxed));
+    };
+
+    std::vector<Frame> stack;
+    stack.push_back({&root, out.addDirectory(FileTable::kNoParent, root.path.string(), root.stamp)});
+    addUsage(root, 0);
+    while (!stack.empty()) {
+        Frame& f = stack.back();
+        DirNode& n = *f.node;
+
+        std::size_t until = f.child < n.children.size() ? n.children[f.child].first : n.sizes.size();
+        for (; f.file < until; ++f.file) {
+            std::size_t begin = f.file == 0 ? 0 : n.nameEnds[f.file - 1];
+            std::string_view name(n.names.data() + begin, n.nameEnds[f.file] - begin);
+            out.addFile(f.dir, name, n.sizes[f.file]);
+        }
+
+        if (f.child < n.children.size()) {
+            auto [position, next] = n.children[f.child++];
+            std::uint32_t dir = out.addDirectory(f.dir, next->path.filename().string(), next->stamp,
+                                                 static_cast<std::uint32_t>(position));
+            addUsage(*next, static_cast<std::uint32_t>(stack.size()));
+            stack.push_back({next, dir});
             continue;
         }
 
-        std::uint64_t size = static_cast<std::uint64_t>(entry.file_size(ec));
-        if (ec) {
-            ++r.skippedEntries;
-            ec.clear();
+        usage.setSubtreeEnd(f.dir, static_cast<std::uint32_t>(out.directoryCount()));
+        n.names = {};
+        n.nameEnds = {};
+        n.sizes = {};
+        stack.pop_back();
+    }
+}
+
+} // namespace
+
+static unsigned resolveThreads(const ScanOptions& options) {
+    if (options.threads == 0) {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+    return options.threads;
+}
+
+static ScanBackend resolveBackend(const ScanOptions& options) {
+#if defined(__linux__)
+    if (options.backend == ScanBackend::Auto) {
+        return ScanBackend::Getdents;
+    }
+    return options.backend;
+#else
+    (void)options;
+    return ScanBackend::StdFilesystem;
+#endif
+}
+
+ScanResult scanDirectoryRecursive(const fs::path& root, const ScanOptions& options) {
+    return scanDirectories({root}, options);
+}
+
+ScanResult scanDirectories(const std::vector<fs::path>& roots, const ScanOptions& options) {
+    ScanResult r;
+    r.inputPathValid = true;
+
+    std::optional<PreviousTree> previous;
+    if (options.previous) {
+        previous.emplace(*options.previous);
+    }
+
+    std::deque<DirNode> tops;
+    std::vector<DirNode*> valid;
+    for (const fs::path& root : roots) {
+        std::error_code ec;
+        if (!fs::exists(root, ec) || !fs::is_directory(root, ec)) {
+            r.inputPathValid = false;
             continue;
         }
+        DirNode& top = tops.emplace_back();
+        top.path = root;
+        if (previous) {
+            top.previous = previous->findRoot(root.string());
+        }
+        valid.push_back(&top);
+    }
+    if (valid.empty()) {
+        return r;
+    }
 
-        FileInfo info;
-        info.path = entry.path();
-        info.size = size;
-        info.extension = info.path.extension().string();
-        normalizeExtension(info.extension);
+    DirWalker walker(options, resolveThreads(options), resolveBackend(options), nullptr,
+                     previous ? &*previous : nullptr);
+    walker.run(valid);
+    walker.mergeInto(r);
 
-        r.files.push_back(std::move(info));
-        addToCategory(r, r.files.back());
+    r.files.reserve(static_cast<std::size_t>(r.totalFiles));
+    for (DirNode* top : valid) {
+        flattenPreorder(*top, r.files, r.usage);
     }
 
     return r;
 }
 
+void mergeScanResult(ScanResult& into, const ScanResult& from, std::size_t largestFiles) {
+    // Usage stays only if both sides have it for every directory, so ids keep matching.
+    bool usage = into.usage.size() == into.files.directoryCount() && from.usage.size() == from.files.directoryCount();
+    into.files.append(from.files);
+    if (usage) {
+        into.usage.append(from.usage);
+    } else {
+        into.usage.clear();
+    }
+
+    mergeStats(into.txt, from.txt);
+    mergeStats(into.images, from.images);
+    mergeStats(into.exe, from.exe);
+    mergeStats(into.other, from.other);
+    for (std::size_t i = 0; i < from.categoryNames.size(); ++i) {
+        auto it = std::ranges::find(into.categoryNames, from.categoryNames[i]);
+        if (it == into.categoryNames.end()) {
+            into.categoryNames.push_back(from.categoryNames[i]);
+            into.categories.emplace_back();
+            it = into.categoryNames.end() - 1;
+        }
+        mergeStats(into.categories[static_cast<std::size_t>(it - into.categoryNames.begin())], from.categories[i]);
+    }
+
+    // Each side kept its own top files, so the top of both lists is the top of the union.
+    into.largest.insert(into.largest.end(), from.largest.begin(), from.largest.end());
+    finishLargest(into.largest, largestFiles);
+
+    into.totalFiles += from.totalFiles;
+    into.totalBytes += from.totalBytes;
+    into.skippedEntries += from.skippedEntries;
+    into.reusedDirectories += from.reusedDirectories;
+    into.inputPathValid = into.inputPathValid && from.inputPathValid;
+}
+
+ScanResult scanDirectoryStreaming(const fs::path& root, const FileVisitor& visitor, const ScanOptions& options) {
+    ScanResult r;
+
+    std::error_code ec;
+    r.inputPathValid = fs::exists(root, ec) && fs::is_directory(root, ec);
+    if (!r.inputPathValid) {
+        return r;
+    }
+
+    DirNode top;
+    top.path = root;
+
+    std::optional<PreviousTree> previous;
+    if (options.previous) {
+        previous.emplace(*options.previous);
+        top.previous = previous->findRoot(root.string());
+    }
+
+    DirWalker walker(options, resolveThreads(options), resolveBackend(options), &visitor,
+                     previous ? &*previous : nullptr);
+    walker.run(top);
+    walker.mergeInto(r);
+
+    return r;
+}
+
+static void removeStats(CategoryStats& s, std::uint64_t size) {
+    --s.count;
+    s.bytes -= size;
+    --s.histogram[sizeBucket(size)];
+}
+
+void addFileStats(ScanResult& r, std::string_view name, std::uint64_t size, const CategoryMatcher* categories) {
+    addToCategory(r, classifyExtension(extensionOf(name)), size);
+    addToCategory(r, categories, name, size);
+}
+
+void removeFileStats(ScanResult& r, std::string_view name, std::uint64_t size, const CategoryMatcher* categories) {
+    --r.totalFiles;
+    r.totalBytes -= size;
+    removeStats(statsOf(r, classifyExtension(extensionOf(name))), size);
+    if (categories) {
+        removeStats(r.categories[categories->match(name, size)], size);
+    }
+}
+
+void computeSizeStats(ScanResult& r, std::size_t largestFiles) {
+    for (CategoryStats* s : {&r.txt, &r.images, &r.exe, &r.other}) {
+        s->histogram = {};
+    }
+    r.largest.clear();
+
+    std::span<const std::uint64_t> sizes = r.files.sizes();
+    std::span<const FileCategory> categories = r.files.categories();
+    for (std::size_t i = 0; i < sizes.size(); ++i) {
+        ++statsOf(r, categories[i]).histogram[sizeBucket(sizes[i])];
+        offerLargeFile(r.largest, largestFiles, sizes[i], [&] { return r.files.path(i); });
+    }
+    finishLargest(r.largest, largestFiles);
+}
+
 std::vector<FileInfo> filterTextFiles(const std::vector<FileInfo>& files) {
-    auto view = files | std::views::filter([](const FileInfo& f) { return f.extension == ".txt"; });
+    auto view = files | std::views::filter([](const FileInfo& f) { return classifyExtension(f.extension) == FileCategory::Text; });
     return {view.begin(), view.end()};
 }
 
 std::vector<FileInfo> filterImageFiles(const std::vector<FileInfo>& files) {
-    auto view = files | std::views::filter([](const FileInfo& f) { return isImageExt(f.extension); });
+    auto view = files | std::views::filter([](const FileInfo& f) { return classifyExtension(f.extension) == FileCategory::Image; });
     return {view.begin(), view.end()};
 }
 
 std::vector<FileInfo> filterExeFiles(const std::vector<FileInfo>& files) {
-    auto view = files | std::views::filter([](const FileInfo& f) { return f.extension == ".exe"; });
+    auto view = files | std::views::filter([](const FileInfo& f) { return classifyExtension(f.extension) == FileCategory::Executable; });
     return {view.begin(), view.end()};
 }
 
@@ -120,15 +1128,53 @@ std::vector<FileInfo> filterLargeFilesGiB(const std::vector<FileInfo>& files, st
 }
 
 std::vector<FileInfo> filterOtherFiles(const std::vector<FileInfo>& files) {
-    auto view = files | std::views::filter([](const FileInfo& f) {
-        bool isTxt = (f.extension == ".txt");
-        bool isImg = isImageExt(f.extension);
-        bool isExe = (f.extension == ".exe");
-        return !(isTxt || isImg || isExe);
-    });
+    auto view = files | std::views::filter([](const FileInfo& f) { return classifyExtension(f.extension) == FileCategory::Other; });
     return {view.begin(), view.end()};
 }
 
+template <typename Pred>
+static void select(const FileTable& files, FileSelection& out, Pred pred) {
+    out.clear();
+    const std::size_t n = files.size();
+    for (std::size_t i = 0; i < n; ++i) {
+        if (pred(i)) {
+            out.push_back(static_cast<std::uint32_t>(i));
+        }
+    }
+}
+
+static void selectCategory(const FileTable& files, FileSelection& out, FileCategory category) {
+    std::span<const FileCategory> categories = files.categories();
+    select(files, out, [&](std::size_t i) { return categories[i] == category; });
+}
+
+void filterTextFiles(const FileTable& files, FileSelection& out) {
+    selectCategory(files, out, FileCategory::Text);
+}
+
+void filterImageFiles(const FileTable& files, FileSelection& out) {
+    selectCategory(files, out, FileCategory::Image);
+}
+
+void filterExeFiles(const FileTable& files, FileSelection& out) {
+    selectCategory(files, out, FileCategory::Executable);
+}
+
+void filterLargeFilesGiB(const FileTable& files, FileSelection& out, std::uint64_t minGiB) {
+    const std::uint64_t threshold = minGiB * 1024ULL * 1024ULL * 1024ULL;
+    std::span<const std::uint64_t> sizes = files.sizes();
+    select(files, out, [&](std::size_t i) { return sizes[i] >= threshold; });
+}
+
+void filterOtherFiles(const FileTable& files, FileSelection& out) {
+    selectCategory(files, out, FileCategory::Other);
+}
+
+void filterCategory(const FileTable& files, const CategoryMatcher& matcher, std::uint16_t category, FileSelection& out) {
+    std::span<const std::uint64_t> sizes = files.sizes();
+    select(files, out, [&](std::size_t i) { return matcher.match(files.name(i), sizes[i]) == category; });
+}
+
 static void printCategory(const std::string& name, const CategoryStats& s) {
     std::cout << name << ":\n";
     std::cout << "  Files: " << s.count << "\n";
@@ -139,10 +1185,16 @@ static void printCategory(const std::string& name, const CategoryStats& s) {
 
 void printSummary(const ScanResult& r) {
     std::cout << "\n=== Summary ===\n";
-    printCategory("Text files (.txt)", r.txt);
-    printCategory("Images (.jpg .jpeg .png .bmp .gif .tiff)", r.images);
-    printCategory("Executables (.exe)", r.exe);
-    printCategory("Other files", r.other);
+    if (!r.categories.empty()) {
+        for (std::size_t i = 0; i < r.categories.size(); ++i) {
+            printCategory(r.categoryNames[i], r.categories[i]);
+        }
+    } else {
+        printCategory("Text files (.txt)", r.txt);
+        printCategory("Images (.jpg .jpeg .png .bmp .gif .tiff)", r.images);
+        printCategory("Executables (.exe)", r.exe);
+        printCategory("Other files", r.other);
+    }
 
     std::cout << "Totals:\n";
     std::cout << "  Files: " << r.totalFiles << "\n";
@@ -154,6 +1206,97 @@ void printSummary(const ScanResult& r) {
     }
 }
 
+void printLargestFiles(const ScanResult& r, std::size_t limit) {
+    std::size_t shown = 0;
+    for (const LargeFile& f : r.largest) {
+        if (shown++ >= limit) {
+            break;
+        }
+        std::cout << f.size << " bytes | " << f.path.string() << "\n";
+    }
+    if (shown == 0) {
+        std::cout << "(no files)\n";
+    }
+}
+
+// "4 KiB" for bucket bounds, which are all powers of two.
+static std::string powerOfTwoLabel(unsigned exponent) {
+    static const char* const units[] = {"B", "KiB", "MiB", "GiB", "TiB", "PiB", "EiB"};
+    return std::to_string(1u << (exponent % 10)) + " " + units[exponent / 10];
+}
+
+static void printHistogram(const std::string& name, const CategoryStats& s) {
+    std::cout << name << ":\n";
+    if (s.histogram[0] > 0) {
+        std::cout << "  empty: " << s.histogram[0] << "\n";
+    }
+    for (unsigned b = 1; b < kSizeBuckets; ++b) {
+        if (s.histogram[b] > 0) {
+            std::cout << "  [" << powerOfTwoLabel(b - 1) << ", " << powerOfTwoLabel(b) << "): " << s.histogram[b] << "\n";
+        }
+    }
+    std::cout << "\n";
+}
+
+void printSizeHistogram(const ScanResult& r) {
+    std::cout << "\n=== Size distribution ===\n";
+    if (!r.categories.empty()) {
+        for (std::size_t i = 0; i < r.categories.size(); ++i) {
+            printHistogram(r.categoryNames[i], r.categories[i]);
+        }
+    } else {
+        printHistogram("Text files (.txt)", r.txt);
+        printHistogram("Images (.jpg .jpeg .png .bmp .gif .tiff)", r.images);
+        printHistogram("Executables (.exe)", r.exe);
+        printHistogram("Other files", r.other);
+    }
+}
+
+void printHeaviestDirectories(const ScanResult& r, std::size_t limit, unsigned maxDepth) {
+    std::vector<std::uint32_t> dirs;
+    r.usage.heaviest(limit, maxDepth, dirs);
+    for (std::uint32_t d : dirs) {
+        std::cout << r.usage.bytes(d) << " bytes | " << r.usage.files(d) << " files | "
+                  << r.files.directoryPath(d).string() << "\n";
+    }
+    if (dirs.empty()) {
+        std::cout << "(no directories)\n";
+    }
+}
+
+void printDuplicates(const FileTable& files, const DuplicateReport& report, std::size_t limit) {
+    if (report.linkedNames > 0) {
+        std::cout << "Hard links (not counted):  " << report.linkedNames << "\n";
+    }
+    std::cout << "Same size as another file: " << report.sizeCandidates << "\n";
+    std::cout << "Same first 4 KiB:          " << report.prefixCandidates << "\n";
+    std::cout << "Read in full:              " << report.fullyHashed << "\n";
+    std::cout << "Bytes read:                " << report.bytesRead << "\n";
+    if (report.unreadable > 0) {
+        std::cout << "Unreadable or changed:     " << report.unreadable << "\n";
+    }
+    std::cout << "Duplicate groups: " << report.groups.size() << ", wasted bytes: " << report.wastedBytes
+              << " (" << (report.wastedBytes / (1024.0 * 1024.0)) << " MB)\n\n";
+
+    std::size_t shown = 0;
+    for (const DuplicateGroup& g : report.groups) {
+        if (shown++ >= limit) {
+            std::cout << "... (limited to " << limit << " groups)\n";
+            break;
+        }
+        std::cout << g.files.size() << " x " << g.size << " bytes:\n";
+        for (std::uint32_t row : g.files) {
+            std::cout << "  " << files.path(row).string() << "\n";
+        }
+        for (std::uint32_t row : g.links) {
+            std::cout << "  " << files.path(row).string() << " (hard link)\n";
+        }
+    }
+    if (shown == 0) {
+        std::cout << "(no duplicates)\n";
+    }
+}
+
 void printFileList(const std::vector<FileInfo>& list, std::size_t limit) {
     std::size_t shown = 0;
     for (const auto& f : list) {
@@ -167,3 +1310,16 @@ void printFileList(const std::vector<FileInfo>& list, std::size_t limit) {
         std::cout << "(no files)\n";
     }
 }
+
+void printFileList(const FileTable& files, const FileSelection& selection, std::size_t limit) {
+    if (selection.empty() || limit == 0) {
+        std::cout << "(no files)\n";
+        return;
+    }
+    ListOptions options;
+    options.limit = limit;
+    writeFileList(std::cout, files, selection, options);
+    if (selection.size() >= limit) {
+        std::cout << "... (limited to " << limit << " items)\n";
+    }
+}
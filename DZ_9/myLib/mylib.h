@@ -1,37 +1,117 @@
 #pragma once
 
+#include <array>
 #include <filesystem>
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <functional>
 
-struct FileInfo {
-    std::filesystem::path path;
-    std::uint64_t size = 0;
-    std::string extension;
-};
+#include "category_rules.h"
+#include "directory_usage.h"
+#include "duplicates.h"
+#include "file_listing.h"
+#include "query.h"
+#include "scan_progress.h"
+#include "file_table.h"
+#include "scan_index.h"
+
+// Bucket 0 counts empty files, bucket b (1..64) sizes in [2^(b-1), 2^b).
+constexpr std::size_t kSizeBuckets = 65;
 
 struct CategoryStats {
     std::uint64_t count = 0;
     std::uint64_t bytes = 0;
+    std::array<std::uint64_t, kSizeBuckets> histogram{};
+};
+
+struct LargeFile {
+    std::filesystem::path path;
+    std::uint64_t size = 0;
 };
 
 struct ScanResult {
-    std::vector<FileInfo> files;
+    FileTable files;
+    // Per-directory totals of `files`. Empty for streaming scans and loaded indexes; see
+    // computeDirectoryUsage().
+    DirectoryUsage usage;
 
     CategoryStats txt;
     CategoryStats images;
     CategoryStats exe;
     CategoryStats other;
 
+    // One bucket per category of ScanOptions::categories, named by categoryNames. Empty when
+    // the scan ran without rules. Not stored in scan indexes.
+    std::vector<CategoryStats> categories;
+    std::vector<std::string> categoryNames;
+
+    // The ScanOptions::largestFiles biggest files, largest first; equal sizes by path.
+    std::vector<LargeFile> largest;
+
     std::uint64_t totalFiles = 0;
     std::uint64_t totalBytes = 0;
     std::uint64_t skippedEntries = 0;
+    std::uint64_t reusedDirectories = 0;
 
     bool inputPathValid = false;
 };
 
-ScanResult scanDirectoryRecursive(const std::filesystem::path& root);
+enum class ScanBackend {
+    Auto,           // Getdents on Linux, StdFilesystem elsewhere
+    StdFilesystem,  // std::filesystem::directory_iterator, portable
+    Getdents,       // Linux: getdents64 into a large buffer, d_type, fstatat on the directory fd
+    IoUring         // Linux: like Getdents, but each directory's stats go out as one io_uring
+                    // batch of statx requests; falls back to Getdents if io_uring is unavailable
+};
+
+struct ScanOptions {
+    // Worker threads for the directory walk; 0 uses std::thread::hardware_concurrency().
+    unsigned threads = 1;
+    ScanBackend backend = ScanBackend::Auto;
+    // Files of an earlier scan of the same root, e.g. from loadScanIndex(). Directories whose
+    // device, inode and mtime are unchanged are copied from it instead of being read again.
+    // A file whose size changes in place does not touch its directory's mtime and is missed.
+    const FileTable* previous = nullptr;
+    // Extra user-defined categories counted into ScanResult::categories during the walk.
+    const CategoryMatcher* categories = nullptr;
+    // Size of ScanResult::largest. Each worker keeps a bounded heap, so this costs one compare
+    // per file once the heap is full.
+    std::size_t largestFiles = 100;
+    // Live counters for progress output; see ScanProgress.
+    ScanProgress* progress = nullptr;
+};
+
+ScanResult scanDirectoryRecursive(const std::filesystem::path& root, const ScanOptions& options = {});
+
+// Scans several roots as one job on one worker pool, so a large root keeps every thread busy
+// while small ones finish. Each root becomes a root directory of `files`, in the given order;
+// overlapping roots are counted twice. Roots that are not directories are skipped and make
+// inputPathValid false.
+ScanResult scanDirectories(const std::vector<std::filesystem::path>& roots, const ScanOptions& options = {});
+
+// Adds `from` to `into` as if both had been scanned together: the file tables are appended
+// (directory ids of `from` shifted, extensions re-interned), counters and histograms summed,
+// rule categories matched by name and the largest files re-ranked. `usage` is kept when both
+// sides have it. Also combines shards scanned by separate processes and saved with
+// saveScanIndex.
+void mergeScanResult(ScanResult& into, const ScanResult& from, std::size_t largestFiles = 100);
+
+// Called once per regular file. The FileInfo is only valid during the call. With more than
+// one thread the visitor runs on the worker threads concurrently and in no particular order.
+using FileVisitor = std::function<void(const FileInfo&)>;
+
+// Same walk as scanDirectoryRecursive, but files are streamed to the visitor instead of being
+// collected: the returned result has empty `files` and only the aggregate statistics.
+// An empty visitor is allowed when only the totals are needed.
+ScanResult scanDirectoryStreaming(const std::filesystem::path& root,
+                                  const FileVisitor& visitor,
+                                  const ScanOptions& options = {});
+
+// Counts one file into, or takes it back out of, the aggregate counters of `r` (totals,
+// categories and histograms) exactly as a scan would. For keeping a result up to date.
+void addFileStats(ScanResult& r, std::string_view name, std::uint64_t size, const CategoryMatcher* categories = nullptr);
+void removeFileStats(ScanResult& r, std::string_view name, std::uint64_t size, const CategoryMatcher* categories = nullptr);
 
 std::vector<FileInfo> filterTextFiles(const std::vector<FileInfo>& files);
 std::vector<FileInfo> filterImageFiles(const std::vector<FileInfo>& files);
@@ -39,5 +119,26 @@ std::vector<FileInfo> filterExeFiles(const std::vector<FileInfo>& files);
 std::vector<FileInfo> filterLargeFilesGiB(const std::vector<FileInfo>& files, std::uint64_t minGiB = 1);
 std::vector<FileInfo> filterOtherFiles(const std::vector<FileInfo>& files);
 
+// Row indices into a FileTable. The FileTable filters clear and refill `out` without copying
+// any file data, so reusing one selection across calls does not allocate once it has grown.
+using FileSelection = std::vector<std::uint32_t>;
+
+void filterTextFiles(const FileTable& files, FileSelection& out);
+void filterImageFiles(const FileTable& files, FileSelection& out);
+void filterExeFiles(const FileTable& files, FileSelection& out);
+void filterLargeFilesGiB(const FileTable& files, FileSelection& out, std::uint64_t minGiB = 1);
+void filterOtherFiles(const FileTable& files, FileSelection& out);
+void filterCategory(const FileTable& files, const CategoryMatcher& matcher, std::uint16_t category, FileSelection& out);
+
+// Fills `largest` and the built-in categories' histograms from r.files, for results that come
+// from loadScanIndex/openScanIndex, which store neither.
+void computeSizeStats(ScanResult& r, std::size_t largestFiles = 100);
+
 void printSummary(const ScanResult& r);
+void printLargestFiles(const ScanResult& r, std::size_t limit = 100);
+void printSizeHistogram(const ScanResult& r);
+// The heaviest directories at most `maxDepth` levels below the root, with their du-style totals.
+void printHeaviestDirectories(const ScanResult& r, std::size_t limit = 20, unsigned maxDepth = 3);
+void printDuplicates(const FileTable& files, const DuplicateReport& report, std::size_t limit = 50);
 void printFileList(const std::vector<FileInfo>& list, std::size_t limit = 200);
+void printFileList(const FileTable& files, const FileSelection& selection, std::size_t limit = 200);
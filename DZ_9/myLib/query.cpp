@@ -0,0 +1,566 @@
+#include "query.h"
+#include "category_rules.h"
+#include "file_table.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+
+namespace {
+
+// Below this many rows per thread the threads cost more than they save.
+constexpr std::size_t kMinRowsPerThread = 64 * 1024;
+
+char lowerByte(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+std::string lowered(std::string_view s) {
+    std::string out(s);
+    std::transform(out.begin(), out.end(), out.begin(), lowerByte);
+    return out;
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+        return lowerByte(x) == lowerByte(y);
+    });
+}
+
+std::string normalizedExtension(std::string_view ext) {
+    if (!ext.empty() && ext.front() == '.') {
+        ext.remove_prefix(1);
+    }
+    return lowered(ext);
+}
+
+// '*' matches any run of bytes, '?' exactly one. Backtracks only to the last '*', so the cost
+// stays linear in practice.
+bool globMatch(std::string_view pattern, std::string_view s) {
+    std::size_t p = 0;
+    std::size_t i = 0;
+    std::size_t star = std::string_view::npos;
+    std::size_t resume = 0;
+    while (i < s.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == s[i])) {
+            ++p;
+            ++i;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            resume = i;
+        } else if (star != std::string_view::npos) {
+            p = star + 1;
+            i = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        ++p;
+    }
+    return p == pattern.size();
+}
+
+bool categoryBit(std::string_view name, std::uint64_t& bits) {
+    static constexpr std::pair<std::string_view, FileCategory> kNames[] = {
+        {"text", FileCategory::Text}, {"image", FileCategory::Image},
+        {"exe", FileCategory::Executable}, {"other", FileCategory::Other}};
+    for (const auto& [n, category] : kNames) {
+        if (equalsIgnoreCase(name, n)) {
+            bits |= std::uint64_t{1} << static_cast<unsigned>(category);
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+// Tables bound to one FileTable for the duration of select().
+struct FileQuery::Bound {
+    const FileTable& files;
+    std::vector<std::vector<bool>> extensionMasks;  // per m_extensionSets entry, by extension id
+};
+
+// Per-thread full path of the last row a path test looked at. A directory's files are
+// consecutive rows, so its "dir/" prefix is built once and only if a path test reaches it.
+struct FileQuery::PathCache {
+    std::uint32_t directory = FileTable::kNoParent;
+    std::size_t prefixLength = 0;
+    std::string path;
+};
+
+class FileQuery::Parser {
+public:
+    Parser(std::string_view text, FileQuery& q)
+        : m_text(text), m_q(q)
+    {
+    }
+
+    bool run(std::string& error) {
+        next();
+        std::uint32_t root = 0;
+        if (!parseOr(root) || !expect(Token::End, "end of query")) {
+            error = m_error;
+            return false;
+        }
+        m_q.m_root = root;
+        return true;
+    }
+
+private:
+    enum class Token { End, Word, String, Operator, LeftParen, RightParen, Comma, Invalid };
+
+    void next() {
+        while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t')) {
+            ++m_pos;
+        }
+        m_start = m_pos;
+        m_value.clear();
+        if (m_pos == m_text.size()) {
+            m_token = Token::End;
+            return;
+        }
+
+        char c = m_text[m_pos];
+        if (c == '(' || c == ')' || c == ',') {
+            m_token = c == '(' ? Token::LeftParen : c == ')' ? Token::RightParen : Token::Comma;
+            ++m_pos;
+            return;
+        }
+        if (c == '"') {
+            m_token = Token::String;
+            for (++m_pos; m_pos < m_text.size() && m_text[m_pos] != '"'; ++m_pos) {
+                if (m_text[m_pos] == '\\' && m_pos + 1 < m_text.size()) {
+                    ++m_pos;
+                }
+                m_value += m_text[m_pos];
+            }
+            if (m_pos == m_text.size()) {
+                m_token = Token::Invalid;
+                return;
+            }
+            ++m_pos;
+            return;
+        }
+        static constexpr std::string_view kOperators[] = {"<=", ">=", "!=", "!~", "==", "&&", "||", "<", ">", "=", "~", "!"};
+        for (std::string_view op : kOperators) {
+            if (m_text.substr(m_pos, op.size()) == op) {
+                m_token = Token::Operator;
+                m_value = op;
+                m_pos += op.size();
+                return;
+            }
+        }
+        m_token = Token::Word;
+        while (m_pos < m_text.size() && std::string_view(" \t()\",<>=!~&|").find(m_text[m_pos]) == std::string_view::npos) {
+            m_value += m_text[m_pos++];
+        }
+        if (m_value.empty()) {
+            m_token = Token::Invalid;
+            ++m_pos;
+        }
+    }
+
+    bool fail(const std::string& expected) {
+        if (m_error.empty()) {
+            std::string found = m_token == Token::End ? "end of query" : "'" + std::string(m_text.substr(m_start, m_pos - m_start)) + "'";
+            m_error = "expected " + expected + " at column " + std::to_string(m_start + 1) + ", found " + found;
+        }
+        return false;
+    }
+
+    bool expect(Token token, const std::string& what) {
+        if (m_token != token) {
+            return fail(what);
+        }
+        next();
+        return true;
+    }
+
+    bool isKeyword(std::string_view word, std::string_view op = {}) const {
+        return (m_token == Token::Word && equalsIgnoreCase(m_value, word)) ||
+               (!op.empty() && m_token == Token::Operator && m_value == op);
+    }
+
+    std::uint32_t add(const Node& node) {
+        m_q.m_nodes.push_back(node);
+        return static_cast<std::uint32_t>(m_q.m_nodes.size() - 1);
+    }
+
+    // A flattened and/or node; its operands are ordered cheapest first, which is safe because
+    // no test has side effects.
+    std::uint32_t addChain(Kind kind, const std::vector<std::uint32_t>& operands) {
+        std::vector<std::uint32_t> flat;
+        for (std::uint32_t o : operands) {
+            // Only a parenthesized chain can be of the same kind here.
+            const Node& child = m_q.m_nodes[o];
+            if (child.kind == kind) {
+                flat.insert(flat.end(), m_q.m_operands.begin() + child.first,
+                            m_q.m_operands.begin() + child.first + child.count);
+            } else {
+                flat.push_back(o);
+            }
+        }
+        std::stable_sort(flat.begin(), flat.end(), [&](std::uint32_t a, std::uint32_t b) {
+            return m_q.m_nodes[a].cost < m_q.m_nodes[b].cost;
+        });
+
+        Node node;
+        node.kind = kind;
+        node.first = static_cast<std::uint32_t>(m_q.m_operands.size());
+        node.count = static_cast<std::uint32_t>(flat.size());
+        for (std::uint32_t o : flat) {
+            node.cost += m_q.m_nodes[o].cost;
+            m_q.m_operands.push_back(o);
+        }
+        return add(node);
+    }
+
+    bool parseOr(std::uint32_t& out) {
+        std::vector<std::uint32_t> operands(1);
+        if (!parseAnd(operands[0])) {
+            return false;
+        }
+        while (isKeyword("or", "||")) {
+            next();
+            if (!parseAnd(operands.emplace_back())) {
+                return false;
+            }
+        }
+        out = operands.size() == 1 ? operands[0] : addChain(Kind::Or, operands);
+        return true;
+    }
+
+    bool parseAnd(std::uint32_t& out) {
+        std::vector<std::uint32_t> operands(1);
+        if (!parseNot(operands[0])) {
+            return false;
+        }
+        while (isKeyword("and", "&&")) {
+            next();
+            if (!parseNot(operands.emplace_back())) {
+                return false;
+            }
+        }
+        out = operands.size() == 1 ? operands[0] : addChain(Kind::And, operands);
+        return true;
+    }
+
+    bool parseNot(std::uint32_t& out) {
+        if (!isKeyword("not", "!")) {
+            return parsePrimary(out);
+        }
+        next();
+        std::uint32_t operand = 0;
+        if (!parseNot(operand)) {
+            return false;
+        }
+        Node node;
+        node.kind = Kind::Not;
+        node.first = static_cast<std::uint32_t>(m_q.m_operands.size());
+        node.count = 1;
+        node.cost = m_q.m_nodes[operand].cost;
+        m_q.m_operands.push_back(operand);
+        out = add(node);
+        return true;
+    }
+
+    bool parsePrimary(std::uint32_t& out) {
+        if (m_token == Token::LeftParen) {
+            next();
+            return parseOr(out) && expect(Token::RightParen, "')'");
+        }
+        if (m_token != Token::Word) {
+            return fail("a field (size, ext, type, name, path), 'not' or '('");
+        }
+
+        std::string field = lowered(m_value);
+        Node node;
+        if (field == "size") {
+            node.kind = Kind::Size;
+        } else if (field == "ext") {
+            node.kind = Kind::Extension;
+        } else if (field == "type") {
+            node.kind = Kind::Type;
+        } else if (field == "name") {
+            node.kind = Kind::Name;
+        } else if (field == "path") {
+            node.kind = Kind::Path;
+        } else {
+            return fail("a field (size, ext, type, name, path)");
+        }
+        next();
+
+        bool in = isKeyword("in");
+        if (!in && !parseCompare(node)) {
+            return false;
+        }
+        switch (node.kind) {
+            case Kind::Size:
+                if (in || node.compare > Compare::NotEqual) {
+                    return fail("<, <=, >, >=, = or != after size");
+                }
+                break;
+            case Kind::Extension:
+            case Kind::Type:
+                if (!in && node.compare != Compare::Equal && node.compare != Compare::NotEqual) {
+                    return fail("=, != or in");
+                }
+                break;
+            default:
+                if (in || node.compare < Compare::Equal) {
+                    return fail("=, !=, ~ or !~");
+                }
+                break;
+        }
+        next();
+
+        switch (node.kind) {
+            case Kind::Size:
+                if (m_token != Token::Word || !parseByteSize(m_value, node.value)) {
+                    return fail("a size such as 4096 or 50M");
+                }
+                node.cost = 1;
+                next();
+                break;
+            case Kind::Extension:
+            case Kind::Type: {
+                std::vector<std::string> values;
+                if (!(in ? parseList(values) : parseValue(values.emplace_back()))) {
+                    return false;
+                }
+                if (node.kind == Kind::Type) {
+                    for (const std::string& v : values) {
+                        if (!categoryBit(v, node.value)) {
+                            m_error = "unknown type '" + v + "' (expected text, image, exe or other)";
+                            return false;
+                        }
+                    }
+                } else {
+                    for (std::string& v : values) {
+                        v = normalizedExtension(v);
+                    }
+                    node.first = static_cast<std::uint32_t>(m_q.m_extensionSets.size());
+                    m_q.m_extensionSets.push_back(std::move(values));
+                }
+                node.cost = 1;
+                break;
+            }
+            case Kind::Name:
+            case Kind::Path:
+                node.first = static_cast<std::uint32_t>(m_q.m_strings.size());
+                if (!parseValue(m_q.m_strings.emplace_back())) {
+                    return false;
+                }
+                node.cost = node.kind == Kind::Name ? 4 : 8;
+                break;
+            default:
+                break;
+        }
+        out = add(node);
+        return true;
+    }
+
+    bool parseCompare(Node& node) {
+        static constexpr std::pair<std::string_view, Compare> kCompares[] = {
+            {"<", Compare::Less}, {"<=", Compare::LessEqual}, {">", Compare::Greater}, {">=", Compare::GreaterEqual},
+            {"=", Compare::Equal}, {"==", Compare::Equal}, {"!=", Compare::NotEqual}, {"~", Compare::Glob},
+            {"!~", Compare::NotGlob}};
+        if (m_token == Token::Operator) {
+            for (const auto& [op, compare] : kCompares) {
+                if (m_value == op) {
+                    node.compare = compare;
+                    return true;
+                }
+            }
+        }
+        return fail("a comparison");
+    }
+
+    bool parseValue(std::string& out) {
+        if (m_token != Token::Word && m_token != Token::String) {
+            return fail("a value");
+        }
+        out = m_value;
+        next();
+        return true;
+    }
+
+    bool parseList(std::vector<std::string>& out) {
+        if (!expect(Token::LeftParen, "'('")) {
+            return false;
+        }
+        do {
+            if (!parseValue(out.emplace_back())) {
+                return false;
+            }
+        } while (m_token == Token::Comma && (next(), true));
+        return expect(Token::RightParen, "',' or ')'");
+    }
+
+    std::string_view m_text;
+    FileQuery& m_q;
+    std::size_t m_pos = 0;
+    std::size_t m_start = 0;
+    Token m_token = Token::End;
+    std::string m_value;
+    std::string m_error;
+};
+
+bool FileQuery::parse(std::string_view text, std::string& error) {
+    FileQuery q;
+    Parser parser(text, q);
+    if (!parser.run(error)) {
+        return false;
+    }
+    // Steps are generated last to first so every target already exists, then reversed so a
+    // row walks the list forwards.
+    q.m_entry = q.lower(q.m_root, kAccept, kReject);
+    const auto count = static_cast<std::uint32_t>(q.m_program.size());
+    auto flip = [count](std::uint32_t target) { return target < count ? count - 1 - target : target; };
+    std::reverse(q.m_program.begin(), q.m_program.end());
+    for (Step& step : q.m_program) {
+        step.onTrue = flip(step.onTrue);
+        step.onFalse = flip(step.onFalse);
+    }
+    q.m_entry = flip(q.m_entry);
+    *this = std::move(q);
+    return true;
+}
+
+std::uint32_t FileQuery::lower(std::uint32_t index, std::uint32_t onTrue, std::uint32_t onFalse) {
+    const Node node = m_nodes[index];
+    switch (node.kind) {
+        case Kind::And:
+        case Kind::Or: {
+            std::uint32_t entry = 0;
+            for (std::uint32_t i = node.count; i-- > 0;) {
+                std::uint32_t operand = m_operands[node.first + i];
+                if (i + 1 == node.count) {
+                    entry = lower(operand, onTrue, onFalse);
+                } else if (node.kind == Kind::And) {
+                    entry = lower(operand, entry, onFalse);
+                } else {
+                    entry = lower(operand, onTrue, entry);
+                }
+            }
+            return entry;
+        }
+        case Kind::Not:
+            return lower(m_operands[node.first], onFalse, onTrue);
+        default:
+            m_program.push_back(Step{index, onTrue, onFalse});
+            return static_cast<std::uint32_t>(m_program.size() - 1);
+    }
+}
+
+bool FileQuery::matches(std::uint32_t row, const Bound& bound, PathCache& paths) const {
+    std::uint32_t step = m_entry;
+    while (step < m_program.size()) {
+        const Step& s = m_program[step];
+        step = test(m_nodes[s.node], row, bound, paths) ? s.onTrue : s.onFalse;
+    }
+    return step == kAccept;
+}
+
+bool FileQuery::test(const Node& node, std::uint32_t row, const Bound& bound, PathCache& paths) const {
+    switch (node.kind) {
+        case Kind::Size: {
+            std::uint64_t size = bound.files.fileSize(row);
+            switch (node.compare) {
+                case Compare::Less: return size < node.value;
+                case Compare::LessEqual: return size <= node.value;
+                case Compare::Greater: return size > node.value;
+                case Compare::GreaterEqual: return size >= node.value;
+                case Compare::NotEqual: return size != node.value;
+                default: return size == node.value;
+            }
+        }
+        case Kind::Extension:
+            return bound.extensionMasks[node.first][bound.files.extensionId(row)] == (node.compare == Compare::Equal);
+        case Kind::Type: {
+            bool member = (node.value >> static_cast<unsigned>(bound.files.category(row))) & 1;
+            return member == (node.compare == Compare::Equal);
+        }
+        case Kind::Name:
+        case Kind::Path: {
+            std::string_view subject = bound.files.name(row);
+            if (node.kind == Kind::Path) {
+                std::uint32_t dir = bound.files.directoryId(row);
+                if (dir != paths.directory) {
+                    paths.directory = dir;
+                    paths.path = bound.files.directoryPath(dir).string();
+                    const char separator = static_cast<char>(std::filesystem::path::preferred_separator);
+                    if (!paths.path.empty() && paths.path.back() != '/' && paths.path.back() != separator) {
+                        paths.path += separator;
+                    }
+                    paths.prefixLength = paths.path.size();
+                }
+                paths.path.resize(paths.prefixLength);
+                paths.path.append(subject);
+                subject = paths.path;
+            }
+            const std::string& pattern = m_strings[node.first];
+            switch (node.compare) {
+                case Compare::Glob: return globMatch(pattern, subject);
+                case Compare::NotGlob: return !globMatch(pattern, subject);
+                case Compare::NotEqual: return subject != pattern;
+                default: return subject == pattern;
+            }
+        }
+        default:
+            break;  // and/or/not were lowered away
+    }
+    return false;
+}
+
+void FileQuery::select(const FileTable& files, std::vector<std::uint32_t>& out, unsigned threads) const {
+    out.clear();
+    if (m_nodes.empty()) {
+        return;
+    }
+
+    Bound bound{files, {}};
+    for (const std::vector<std::string>& set : m_extensionSets) {
+        std::vector<bool>& mask = bound.extensionMasks.emplace_back(files.extensionCount());
+        for (std::uint32_t id = 0; id < files.extensionCount(); ++id) {
+            mask[id] = std::find(set.begin(), set.end(), normalizedExtension(files.extensionName(id))) != set.end();
+        }
+    }
+    auto run = [&](std::size_t begin, std::size_t end, std::vector<std::uint32_t>& rows) {
+        PathCache paths;
+        for (std::size_t i = begin; i < end; ++i) {
+            if (matches(static_cast<std::uint32_t>(i), bound, paths)) {
+                rows.push_back(static_cast<std::uint32_t>(i));
+            }
+        }
+    };
+
+    const std::size_t n = files.size();
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    const std::size_t chunks = std::min<std::size_t>(threads, n / kMinRowsPerThread);
+    if (chunks <= 1) {
+        run(0, n, out);
+        return;
+    }
+
+    std::vector<std::vector<std::uint32_t>> parts(chunks);
+    std::vector<std::thread> pool;
+    for (std::size_t c = 0; c < chunks; ++c) {
+        pool.emplace_back([&, c] { run(n * c / chunks, n * (c + 1) / chunks, parts[c]); });
+    }
+    for (std::thread& t : pool) {
+        t.join();
+    }
+    std::size_t total = 0;
+    for (const auto& part : parts) {
+        total += part.size();
+    }
+    out.reserve(total);
+    for (const auto& part : parts) {
+        out.insert(out.end(), part.begin(), part.end());
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class FileTable;
+
+// Filter expressions over scan results, for example
+//
+//   ext in (jpg, png) and size > 50M and path ~ "/var/*"
+//   not type = text or name ~ "*.tar.*"
+//
+//   size  < <= > >= = !=   a byte count, with binary K/M/G/T suffixes
+//   ext   = != in (...)    extensions, with or without the leading '.', any case; "" is none
+//   type  = != in (...)    the built-in categories: text, image, exe, other
+//   name  = != ~ !~        the leaf name; ~ is a glob where '*' matches any run of bytes and
+//   path  = != ~ !~        '?' exactly one, case-sensitive; for path '*' also crosses '/'
+//
+// combined with not, and, or (also !, &&, ||) and parentheses; and binds tighter than or.
+// Values are single words or double-quoted strings.
+//
+// The expression is parsed once into a tree whose and/or chains are flattened, with the cheap
+// column tests (size, ext, type) moved before the string tests, and then lowered to a flat list
+// of tests that each name the step to take on true and on false, so a row is matched without
+// recursion and path tests run last. Extension and type tests are bound to a table as one
+// lookup per interned extension, and a directory's path is only built once a path test reaches
+// one of its files, so the query costs one pass over the table and no per-file allocation.
+class FileQuery {
+public:
+    // On failure `error` says what was expected where and the query is left unchanged.
+    bool parse(std::string_view text, std::string& error);
+
+    bool empty() const { return m_nodes.empty(); }
+
+    // Rows of `files` that match, in table order. Large tables are split into chunks that are
+    // evaluated on `threads` threads (0: std::thread::hardware_concurrency()).
+    void select(const FileTable& files, std::vector<std::uint32_t>& out, unsigned threads = 0) const;
+
+private:
+    enum class Kind : std::uint8_t { And, Or, Not, Size, Extension, Type, Name, Path };
+    enum class Compare : std::uint8_t { Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual, Glob, NotGlob };
+
+    struct Node {
+        Kind kind = Kind::And;
+        Compare compare = Compare::Equal;
+        std::uint64_t value = 0;  // Size: bytes; Type: bit per FileCategory
+        std::uint32_t first = 0;  // And/Or/Not: m_operands; Extension: m_extensionSets; Name/Path: m_strings
+        std::uint32_t count = 0;  // And/Or/Not: operands
+        std::uint32_t cost = 0;
+    };
+
+    // One leaf test of the lowered expression.
+    struct Step {
+        std::uint32_t node = 0;     // in m_nodes
+        std::uint32_t onTrue = 0;   // next step, or kAccept / kReject
+        std::uint32_t onFalse = 0;
+    };
+    static constexpr std::uint32_t kAccept = ~std::uint32_t{0};
+    static constexpr std::uint32_t kReject = kAccept - 1;
+
+    struct Bound;
+    struct PathCache;
+    class Parser;
+
+    std::uint32_t lower(std::uint32_t node, std::uint32_t onTrue, std::uint32_t onFalse);
+    bool test(const Node& node, std::uint32_t row, const Bound& bound, PathCache& paths) const;
+    bool matches(std::uint32_t row, const Bound& bound, PathCache& paths) const;
+
+    std::vector<Node> m_nodes;
+    std::vector<std::uint32_t> m_operands;
+    std::vector<std::vector<std::string>> m_extensionSets;  // lowercase, without '.'
+    std::vector<std::string> m_strings;
+    std::uint32_t m_root = 0;
+    std::vector<Step> m_program;
+    std::uint32_t m_entry = kReject;
+};
@@ -0,0 +1,420 @@
+#include "scan_index.h"
+#include "mylib.h"
+
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char kMagic[8] = {'D', 'Z', '9', 'S', 'C', 'A', 'N', '\0'};
+constexpr std::uint32_t kVersion = 1;
+constexpr std::uint32_t kByteOrder = 0x01020304;
+
+enum Section {
+    FileDirs,
+    FileNameOffsets,
+    FileNameLengths,
+    Sizes,
+    ExtIds,
+    Categories,
+    DirParents,
+    DirNameOffsets,
+    DirNameLengths,
+    DirStamps,
+    DirPositions,
+    Names,
+    ExtOffsets,
+    ExtNames,
+    ExtCategories,
+    SectionCount
+};
+
+struct SectionRef {
+    std::uint64_t offset = 0;
+    std::uint64_t bytes = 0;
+};
+
+struct IndexHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint64_t files;
+    std::uint64_t directories;
+    std::uint64_t extensions;
+    std::uint64_t stats[11];
+    std::array<SectionRef, SectionCount> sections;
+};
+
+constexpr std::uint64_t align8(std::uint64_t n) {
+    return (n + 7) & ~std::uint64_t{7};
+}
+
+void packStats(const ScanResult& r, std::uint64_t* out) {
+    const std::uint64_t values[] = {
+        r.txt.count, r.txt.bytes, r.images.count, r.images.bytes, r.exe.count, r.exe.bytes,
+        r.other.count, r.other.bytes, r.totalFiles, r.totalBytes, r.skippedEntries
+    };
+    std::memcpy(out, values, sizeof(values));
+}
+
+void unpackStats(const std::uint64_t* in, ScanResult& r) {
+    std::uint64_t* fields[] = {
+        &r.txt.count, &r.txt.bytes, &r.images.count, &r.images.bytes, &r.exe.count, &r.exe.bytes,
+        &r.other.count, &r.other.bytes, &r.totalFiles, &r.totalBytes, &r.skippedEntries
+    };
+    for (std::size_t i = 0; i < std::size(fields); ++i) {
+        *fields[i] = in[i];
+    }
+}
+
+class StreamSource {
+    std::ifstream& m_in;
+
+public:
+    explicit StreamSource(std::ifstream& in)
+        : m_in(in)
+    {
+    }
+
+    template <typename T>
+    bool column(const SectionRef& s, std::uint64_t count, Column<T>& out) {
+        if (count > s.bytes / sizeof(T) || s.bytes != count * sizeof(T)) {
+            return false;
+        }
+        std::vector<T> values(static_cast<std::size_t>(count));
+        m_in.seekg(static_cast<std::streamoff>(s.offset));
+        m_in.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(s.bytes));
+        out = Column<T>(std::move(values));
+        return static_cast<bool>(m_in);
+    }
+};
+
+class MappedSource {
+    const char* m_base;
+
+public:
+    explicit MappedSource(const char* base)
+        : m_base(base)
+    {
+    }
+
+    template <typename T>
+    bool column(const SectionRef& s, std::uint64_t count, Column<T>& out) {
+        if (count > s.bytes / sizeof(T) || s.bytes != count * sizeof(T) || s.offset % alignof(T) != 0) {
+            return false;
+        }
+        out.borrow(reinterpret_cast<const T*>(m_base + s.offset), static_cast<std::size_t>(count));
+        return true;
+    }
+};
+
+// Read-only view of a whole file that stays valid until the last shared_ptr is released.
+class MappedFile {
+    const char* m_data = nullptr;
+    std::uint64_t m_size = 0;
+#if defined(_WIN32)
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_view = nullptr;
+#endif
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#if defined(_WIN32)
+        if (m_data) UnmapViewOfFile(m_data);
+        if (m_view) CloseHandle(m_view);
+        if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+#else
+        if (m_data) ::munmap(const_cast<char*>(m_data), static_cast<std::size_t>(m_size));
+#endif
+    }
+
+    const char* data() const { return m_data; }
+    std::uint64_t size() const { return m_size; }
+
+    static std::shared_ptr<MappedFile> open(const fs::path& file) {
+        auto m = std::make_shared<MappedFile>();
+#if defined(_WIN32)
+        m->m_file = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m->m_file == INVALID_HANDLE_VALUE) {
+            return nullptr;
+        }
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(m->m_file, &size) || size.QuadPart == 0) {
+            return nullptr;
+        }
+        m->m_view = CreateFileMappingW(m->m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m->m_view) {
+            return nullptr;
+        }
+        m->m_data = static_cast<const char*>(MapViewOfFile(m->m_view, FILE_MAP_READ, 0, 0, 0));
+        m->m_size = static_cast<std::uint64_t>(size.QuadPart);
+#else
+        int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return nullptr;
+        }
+        struct stat st {};
+        if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return nullptr;
+        }
+        void* p = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            return nullptr;
+        }
+        m->m_data = static_cast<const char*>(p);
+        m->m_size = static_cast<std::uint64_t>(st.st_size);
+#endif
+        return m->m_data ? m : nullptr;
+    }
+};
+
+bool checkHeader(const IndexHeader& h, std::uint64_t fileBytes) {
+    if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || h.version != kVersion || h.byteOrder != kByteOrder) {
+        return false;
+    }
+    for (const SectionRef& s : h.sections) {
+        if (s.offset > fileBytes || s.bytes > fileBytes - s.offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+// Friend of FileTable: the index is a dump of its columns.
+class ScanIndexIO {
+public:
+    static bool save(const ScanResult& r, const fs::path& file);
+    static bool load(const fs::path& file, ScanResult& out);
+    static bool open(const fs::path& file, ScanResult& out, bool verifyRows);
+
+private:
+    template <typename Source>
+    static bool fillTable(const IndexHeader& h, Source& src, FileTable& t);
+    static bool checkDirectories(const IndexHeader& h, const FileTable& t);
+    static bool checkFiles(const IndexHeader& h, const FileTable& t);
+};
+
+// Shared by the copying and the mapping loader. Only the extension table (a few hundred
+// entries) is turned into owned strings; every per-file and per-directory column comes
+// straight from the source.
+template <typename Source>
+bool ScanIndexIO::fillTable(const IndexHeader& h, Source& src, FileTable& t) {
+    const auto& sec = h.sections;
+    Column<char> extNames;
+    Column<std::uint64_t> extOffsets;
+    Column<FileCategory> extCategories;
+    if (h.extensions >= h.extensions + 1) {
+        return false;
+    }
+
+    bool ok = src.column(sec[FileDirs], h.files, t.m_fileDirs) &&
+              src.column(sec[FileNameOffsets], h.files, t.m_fileNameOffsets) &&
+              src.column(sec[FileNameLengths], h.files, t.m_fileNameLengths) &&
+              src.column(sec[Sizes], h.files, t.m_sizes) &&
+              src.column(sec[ExtIds], h.files, t.m_extIds) &&
+              src.column(sec[Categories], h.files, t.m_categories) &&
+              src.column(sec[DirParents], h.directories, t.m_dirParents) &&
+              src.column(sec[DirNameOffsets], h.directories, t.m_dirNameOffsets) &&
+              src.column(sec[DirNameLengths], h.directories, t.m_dirNameLengths) &&
+              src.column(sec[DirStamps], h.directories, t.m_dirStamps) &&
+              src.column(sec[DirPositions], h.directories, t.m_dirPositions) &&
+              src.column(sec[Names], sec[Names].bytes, t.m_names) &&
+              src.column(sec[ExtOffsets], h.extensions + 1, extOffsets) &&
+              src.column(sec[ExtNames], sec[ExtNames].bytes, extNames) &&
+              src.column(sec[ExtCategories], h.extensions, extCategories);
+    if (!ok) {
+        return false;
+    }
+
+    for (std::uint64_t e = 0; e < h.extensions; ++e) {
+        if (extOffsets[e] > extOffsets[e + 1] || extOffsets[e + 1] > extNames.size() ||
+            extCategories[e] > FileCategory::Other) {
+            return false;
+        }
+        t.m_extensions.emplace_back(extNames.data() + extOffsets[e], extOffsets[e + 1] - extOffsets[e]);
+        t.m_extCategories.push_back(extCategories[e]);
+        t.m_extIndex.emplace(t.m_extensions.back(), static_cast<std::uint32_t>(e));
+    }
+    return true;
+}
+
+// Every id points at an existing row and every name into the names column, and parents come
+// before their children, so nothing read from the table can go out of bounds or loop.
+bool ScanIndexIO::checkFiles(const IndexHeader& h, const FileTable& t) {
+    const std::uint64_t names = t.m_names.size();
+    for (std::uint64_t i = 0; i < h.files; ++i) {
+        if (t.m_fileDirs[i] >= h.directories || t.m_extIds[i] >= h.extensions ||
+            t.m_categories[i] > FileCategory::Other || t.m_fileNameOffsets[i] > names ||
+            t.m_fileNameLengths[i] > names - t.m_fileNameOffsets[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ScanIndexIO::checkDirectories(const IndexHeader& h, const FileTable& t) {
+    const std::uint64_t names = t.m_names.size();
+    for (std::uint64_t d = 0; d < h.directories; ++d) {
+        if ((t.m_dirParents[d] != FileTable::kNoParent && t.m_dirParents[d] >= d) ||
+            t.m_dirNameOffsets[d] > names || t.m_dirNameLengths[d] > names - t.m_dirNameOffsets[d]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool ScanIndexIO::save(const ScanResult& r, const fs::path& file) {
+    const FileTable& t = r.files;
+
+    std::string extNames;
+    std::vector<std::uint64_t> extOffsets{0};
+    for (const auto& e : t.m_extensions) {
+        extNames += e;
+        extOffsets.push_back(extNames.size());
+    }
+
+    struct Blob {
+        const void* data;
+        std::uint64_t bytes;
+    };
+    auto blob = [](const auto& v) {
+        return Blob{v.data(), static_cast<std::uint64_t>(v.size() * sizeof(v[0]))};
+    };
+
+    const std::array<Blob, SectionCount> blobs = {
+        blob(t.m_fileDirs), blob(t.m_fileNameOffsets), blob(t.m_fileNameLengths), blob(t.m_sizes),
+        blob(t.m_extIds), blob(t.m_categories), blob(t.m_dirParents), blob(t.m_dirNameOffsets),
+        blob(t.m_dirNameLengths), blob(t.m_dirStamps), blob(t.m_dirPositions), blob(t.m_names),
+        blob(extOffsets), blob(extNames), blob(t.m_extCategories)
+    };
+
+    IndexHeader h{};
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.byteOrder = kByteOrder;
+    h.files = t.size();
+    h.directories = t.directoryCount();
+    h.extensions = t.extensionCount();
+    packStats(r, h.stats);
+
+    std::uint64_t offset = align8(sizeof(IndexHeader));
+    for (std::size_t i = 0; i < SectionCount; ++i) {
+        h.sections[i] = {offset, blobs[i].bytes};
+        offset = align8(offset + blobs[i].bytes);
+    }
+
+    fs::path tmp = file;
+    tmp += ".tmp";
+    bool written = false;
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (out) {
+            static const char zeros[8] = {};
+            out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            out.write(zeros, static_cast<std::streamsize>(align8(sizeof(h)) - sizeof(h)));
+            for (const Blob& b : blobs) {
+                out.write(static_cast<const char*>(b.data), static_cast<std::streamsize>(b.bytes));
+                out.write(zeros, static_cast<std::streamsize>(align8(b.bytes) - b.bytes));
+            }
+            out.close();
+            written = !out.fail();
+        }
+    }
+
+    std::error_code ec;
+    if (written) {
+        fs::rename(tmp, file, ec);
+    }
+    if (!written || ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+bool ScanIndexIO::load(const fs::path& file, ScanResult& out) {
+    std::error_code ec;
+    const std::uint64_t fileBytes = fs::file_size(file, ec);
+    if (ec || fileBytes < sizeof(IndexHeader)) {
+        return false;
+    }
+
+    std::ifstream in(file, std::ios::binary);
+    IndexHeader h{};
+    if (!in.read(reinterpret_cast<char*>(&h), sizeof(h)) || !checkHeader(h, fileBytes)) {
+        return false;
+    }
+
+    ScanResult r;
+    FileTable& t = r.files;
+    StreamSource src(in);
+    if (!fillTable(h, src, t) || !checkDirectories(h, t) || !checkFiles(h, t)) {
+        return false;
+    }
+
+    unpackStats(h.stats, r);
+    r.inputPathValid = true;
+    out = std::move(r);
+    return true;
+}
+
+bool ScanIndexIO::open(const fs::path& file, ScanResult& out, bool verifyRows) {
+    std::shared_ptr<MappedFile> mapping = MappedFile::open(file);
+    if (!mapping || mapping->size() < sizeof(IndexHeader)) {
+        return false;
+    }
+
+    IndexHeader h{};
+    std::memcpy(&h, mapping->data(), sizeof(h));
+    if (!checkHeader(h, mapping->size())) {
+        return false;
+    }
+
+    ScanResult r;
+    MappedSource src(mapping->data());
+    if (!fillTable(h, src, r.files) || !checkDirectories(h, r.files) ||
+        (verifyRows && !checkFiles(h, r.files))) {
+        return false;
+    }
+    r.files.m_mapping = std::move(mapping);
+
+    unpackStats(h.stats, r);
+    r.inputPathValid = true;
+    out = std::move(r);
+    return true;
+}
+
+bool saveScanIndex(const ScanResult& r, const fs::path& file) {
+    return ScanIndexIO::save(r, file);
+}
+
+bool loadScanIndex(const fs::path& file, ScanResult& out) {
+    return ScanIndexIO::load(file, out);
+}
+
+bool openScanIndex(const fs::path& file, ScanResult& out, bool verifyRows) {
+    return ScanIndexIO::open(file, out, verifyRows);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <filesystem>
+
+struct ScanResult;
+
+// Binary snapshot of a ScanResult: a fixed header with the summary counters and a section
+// table, followed by the raw FileTable columns, each 8-byte aligned. Meant to be fed back as
+// ScanOptions::previous on the next run. The file is written next to `file` and renamed into
+// place, so an interrupted save never leaves a truncated index behind.
+bool saveScanIndex(const ScanResult& r, const std::filesystem::path& file);
+
+// Returns false if the file is missing, has a different version or byte order, or fails the
+// bounds checks; `out` is left untouched in that case.
+bool loadScanIndex(const std::filesystem::path& file, ScanResult& out);
+
+// Maps the index read-only instead of reading it. The FileTable columns point straight into
+// the mapping and are copied to the heap only if the table is modified. Opening checks the
+// header, the directory and the extension tables, so it costs O(directories) and leaves the
+// per-file columns untouched until they are used. The file rows themselves are trusted unless
+// `verifyRows` is set, which runs loadScanIndex's checks over them too (one pass over the
+// id and name columns); set it for files that did not come from saveScanIndex.
+bool openScanIndex(const std::filesystem::path& file, ScanResult& out, bool verifyRows = false);
@@ -0,0 +1,92 @@
+#include "scan_progress.h"
+
+#include <cerrno>
+
+ScanErrno classifyErrno(int err) {
+    switch (err) {
+        case ENOENT: return ScanErrno::NotFound;
+        case EACCES:
+        case EPERM: return ScanErrno::Permission;
+        case ELOOP: return ScanErrno::Loop;
+        case ENAMETOOLONG: return ScanErrno::NameTooLong;
+        case EMFILE:
+        case ENFILE: return ScanErrno::TooManyOpenFiles;
+        case EIO: return ScanErrno::Io;
+        default: return ScanErrno::Other;
+    }
+}
+
+const char* scanErrnoName(ScanErrno e) {
+    switch (e) {
+        case ScanErrno::NotFound: return "ENOENT";
+        case ScanErrno::Permission: return "EACCES/EPERM";
+        case ScanErrno::Loop: return "ELOOP";
+        case ScanErrno::NameTooLong: return "ENAMETOOLONG";
+        case ScanErrno::TooManyOpenFiles: return "EMFILE/ENFILE";
+        case ScanErrno::Io: return "EIO";
+        case ScanErrno::Other:
+        case ScanErrno::Count: break;
+    }
+    return "other";
+}
+
+std::uint64_t ScanCounters::errorCount() const {
+    std::uint64_t n = 0;
+    for (std::uint64_t e : errors) {
+        n += e;
+    }
+    return n;
+}
+
+void ScanProgress::begin(unsigned workers) {
+    std::lock_guard lock(m_mutex);
+    if (workers > m_slotCount) {
+        m_slots = std::make_unique<Slot[]>(workers);
+        m_slotCount = workers;
+    } else {
+        for (unsigned i = 0; i < m_slotCount; ++i) {
+            for (auto& v : m_slots[i].values) {
+                v.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+    m_start = std::chrono::steady_clock::now();
+    m_running = true;
+}
+
+void ScanProgress::finish() {
+    std::lock_guard lock(m_mutex);
+    m_end = std::chrono::steady_clock::now();
+    m_running = false;
+}
+
+ScanCounters ScanProgress::snapshot() const {
+    std::lock_guard lock(m_mutex);
+
+    std::uint64_t sums[CounterCount] = {};
+    for (unsigned i = 0; i < m_slotCount; ++i) {
+        for (unsigned c = 0; c < CounterCount; ++c) {
+            sums[c] += m_slots[i].values[c].load(std::memory_order_relaxed);
+        }
+    }
+
+    ScanCounters s;
+    s.entries = sums[Entries];
+    s.directories = sums[Directories];
+    s.reusedDirectories = sums[ReusedDirectories];
+    s.statCalls = sums[StatCalls];
+    s.files = sums[Files];
+    s.bytes = sums[Bytes];
+    s.syscallNs = sums[SyscallNs];
+    s.classifyNs = sums[ClassifyNs];
+    for (std::size_t e = 0; e < s.errors.size(); ++e) {
+        s.errors[e] = sums[FirstErrno + e];
+    }
+
+    s.running = m_running;
+    if (m_slotCount > 0) {
+        auto end = m_running ? std::chrono::steady_clock::now() : m_end;
+        s.elapsedSeconds = std::chrono::duration<double>(end - m_start).count();
+    }
+    return s;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// errno values that ScanCounters breaks out; anything else is counted as Other.
+enum class ScanErrno : std::uint8_t {
+    NotFound,          // ENOENT: removed while being scanned
+    Permission,        // EACCES, EPERM
+    Loop,              // ELOOP
+    NameTooLong,       // ENAMETOOLONG
+    TooManyOpenFiles,  // EMFILE, ENFILE
+    Io,                // EIO
+    Other,
+    Count
+};
+
+ScanErrno classifyErrno(int err);
+const char* scanErrnoName(ScanErrno e);
+
+struct ScanCounters {
+    std::uint64_t entries = 0;            // names read from directories, without "." and ".."
+    std::uint64_t directories = 0;        // directories opened for listing
+    std::uint64_t reusedDirectories = 0;  // taken from ScanOptions::previous instead
+    std::uint64_t statCalls = 0;          // stat requests, synchronous or through io_uring
+    std::uint64_t files = 0;
+    std::uint64_t bytes = 0;
+    std::array<std::uint64_t, static_cast<std::size_t>(ScanErrno::Count)> errors{};
+    // Only with timing enabled: time inside directory listing and stat calls, and time spent
+    // classifying and counting files. Summed over all workers.
+    std::uint64_t syscallNs = 0;
+    std::uint64_t classifyNs = 0;
+
+    double elapsedSeconds = 0.0;
+    bool running = false;
+
+    std::uint64_t errorCount() const;
+};
+
+// Live counters of a scan, for progress output from another thread: pass it in
+// ScanOptions::progress and call snapshot() whenever convenient. Each worker thread writes its
+// own cache-line-aligned slot with plain relaxed loads and stores (no locked instructions, no
+// sharing), so keeping the counters costs a few adds per entry; readers sum the slots.
+// Timing needs two clock reads per syscall and per file and is therefore opt-in.
+// One ScanProgress follows one scan at a time; it is reset when the next scan starts.
+class ScanProgress {
+public:
+    enum Counter : unsigned {
+        Entries,
+        Directories,
+        ReusedDirectories,
+        StatCalls,
+        Files,
+        Bytes,
+        SyscallNs,
+        ClassifyNs,
+        FirstErrno,
+        CounterCount = FirstErrno + static_cast<unsigned>(ScanErrno::Count)
+    };
+
+    struct alignas(64) Slot {
+        std::array<std::atomic<std::uint64_t>, CounterCount> values{};
+
+        // Only the owning worker writes a slot, so no read-modify-write is needed.
+        void add(Counter c, std::uint64_t n = 1) {
+            std::atomic<std::uint64_t>& v = values[c];
+            v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        void addError(int err) {
+            add(static_cast<Counter>(FirstErrno + static_cast<unsigned>(classifyErrno(err))));
+        }
+    };
+
+    explicit ScanProgress(bool timing = false)
+        : m_timing(timing)
+    {
+    }
+
+    bool timing() const { return m_timing; }
+
+    // May be called from any thread at any time, also before and after the scan.
+    ScanCounters snapshot() const;
+
+    // Used by the scanner.
+    void begin(unsigned workers);
+    Slot& slot(unsigned worker) { return m_slots[worker]; }
+    void finish();
+
+private:
+    bool m_timing;
+    mutable std::mutex m_mutex;
+    std::unique_ptr<Slot[]> m_slots;
+    unsigned m_slotCount = 0;
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_end;
+    bool m_running = false;
+};
+
+// Adds the time from construction to destruction to a slot counter; does nothing, not even
+// reading the clock, when `slot` is null.
+class ScanTimer {
+public:
+    ScanTimer(ScanProgress::Slot* slot, ScanProgress::Counter counter)
+        : m_slot(slot), m_counter(counter)
+    {
+        if (m_slot) {
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ScanTimer(const ScanTimer&) = delete;
+    ScanTimer& operator=(const ScanTimer&) = delete;
+
+    ~ScanTimer() {
+        if (m_slot) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start);
+            m_slot->add(m_counter, static_cast<std::uint64_t>(ns.count()));
+        }
+    }
+
+private:
+    ScanProgress::Slot* m_slot;
+    ScanProgress::Counter m_counter;
+    std::chrono::steady_clock::time_point m_start;
+};
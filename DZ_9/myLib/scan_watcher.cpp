@@ -0,0 +1,259 @@
+#include "scan_watcher.h"
+
+#if defined(__linux__)
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr std::uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY |
+                                     IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR |
+                                     IN_EXCL_UNLINK;
+constexpr auto kBatchQuiet = std::chrono::milliseconds(50);
+constexpr auto kBatchMax = std::chrono::milliseconds(500);
+
+} // namespace
+
+ScanWatcher::~ScanWatcher() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+bool ScanWatcher::start(const fs::path& root, const ScanOptions& options) {
+    m_root = root;
+    m_options = options;
+    m_options.previous = nullptr;
+    m_options.largestFiles = 0;
+    m_options.progress = nullptr;
+    return rescan();
+}
+
+// Drops every watch and starts over from a full scan; also the recovery from a queue overflow.
+bool ScanWatcher::rescan() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+    m_dirs.clear();
+    m_dirty.clear();
+    m_unwatched = 0;
+    m_overflow = false;
+
+    m_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        return false;
+    }
+
+    m_result = scanDirectoryRecursive(m_root, m_options);
+    if (!m_result.inputPathValid) {
+        return false;
+    }
+    import(m_result.files, -1, {}, false);
+    m_result.files = {};
+    m_result.usage.clear();
+    m_result.largest.clear();
+    return true;
+}
+
+// Adds watches for every directory of `table`, a scan of a directory that is `name` in the
+// watched directory `parent` (or the root), and records its files. The scan has already
+// counted them; with `count` false the counters are taken from it as they are.
+void ScanWatcher::import(const FileTable& table, int parent, const std::string& name, bool count) {
+    std::vector<int> wds(table.directoryCount(), -1);
+    for (std::uint32_t d = 0; d < table.directoryCount(); ++d) {
+        int up = d == 0 ? parent : wds[table.directoryParent(d)];
+        if (d > 0 && up < 0) {
+            ++m_unwatched;
+            continue;
+        }
+
+        fs::path path = table.directoryPath(d);
+        int wd = ::inotify_add_watch(m_fd, path.c_str(), kWatchMask);
+        // The same inode reached twice (bind mounts) shares one watch; count it once.
+        if (wd < 0 || m_dirs.contains(wd)) {
+            ++m_unwatched;
+            continue;
+        }
+        wds[d] = wd;
+
+        WatchedDir& dir = m_dirs[wd];
+        dir.path = std::move(path);
+        dir.parent = up;
+        if (up >= 0) {
+            m_dirs[up].subdirs[d == 0 ? name : std::string(table.directoryName(d))] = wd;
+        }
+    }
+
+    for (std::uint32_t row = 0; row < table.size(); ++row) {
+        int wd = wds[table.directoryId(row)];
+        std::string_view fileName = table.name(row);
+        if (wd < 0) {
+            if (!count) {
+                removeFileStats(m_result, fileName, table.fileSize(row), m_options.categories);
+            }
+            continue;
+        }
+        m_dirs[wd].files.emplace(fileName, table.fileSize(row));
+        if (count) {
+            addFileStats(m_result, fileName, table.fileSize(row), m_options.categories);
+        }
+    }
+}
+
+void ScanWatcher::removeSubtree(int wd) {
+    auto it = m_dirs.find(wd);
+    if (it == m_dirs.end()) {
+        return;
+    }
+    WatchedDir dir = std::move(it->second);
+    m_dirs.erase(it);
+    m_dirty.erase(wd);
+    ::inotify_rm_watch(m_fd, wd);
+
+    for (const auto& [name, size] : dir.files) {
+        removeFileStats(m_result, name, size, m_options.categories);
+    }
+    for (const auto& [name, child] : dir.subdirs) {
+        removeSubtree(child);
+    }
+    if (auto p = m_dirs.find(dir.parent); p != m_dirs.end()) {
+        auto s = p->second.subdirs.find(dir.path.filename().string());
+        if (s != p->second.subdirs.end() && s->second == wd) {
+            p->second.subdirs.erase(s);
+        }
+    }
+}
+
+// Drains the queue. File events only mark the name dirty, so a file written a thousand times
+// in one batch is stat'ed once; directory events are kept in order.
+bool ScanWatcher::readEvents(std::vector<DirEvent>& dirEvents) {
+    alignas(inotify_event) char buffer[64 * 1024];
+    bool any = false;
+    for (;;) {
+        ssize_t n = ::read(m_fd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            return any;
+        }
+        any = true;
+        for (ssize_t off = 0; off < n;) {
+            const auto* e = reinterpret_cast<const inotify_event*>(buffer + off);
+            off += static_cast<ssize_t>(sizeof(inotify_event) + e->len);
+
+            if (e->mask & IN_Q_OVERFLOW) {
+                m_overflow = true;
+                continue;
+            }
+            std::string name = e->len > 0 ? std::string(e->name) : std::string();
+            if (e->mask & (IN_ISDIR | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                dirEvents.push_back({e->wd, e->mask, std::move(name)});
+            } else if (!name.empty()) {
+                m_dirty[e->wd].insert(std::move(name));
+            }
+        }
+    }
+}
+
+void ScanWatcher::applyDirEvent(const DirEvent& e) {
+    auto it = m_dirs.find(e.wd);
+    if (it == m_dirs.end()) {
+        return;
+    }
+
+    if (e.mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+        // Subdirectories are handled through their parent's IN_DELETE/IN_MOVED_FROM; only
+        // the root itself, or a watch the kernel dropped, has to be handled here.
+        if (it->second.parent < 0 || (e.mask & IN_IGNORED)) {
+            removeSubtree(e.wd);
+        }
+        return;
+    }
+
+    WatchedDir& dir = it->second;
+    if (auto s = dir.subdirs.find(e.name); s != dir.subdirs.end()) {
+        removeSubtree(s->second);
+    }
+    if (e.mask & (IN_CREATE | IN_MOVED_TO)) {
+        fs::path path = dir.path / e.name;
+        ScanResult sub = scanDirectoryRecursive(path, m_options);
+        if (sub.inputPathValid) {
+            import(sub.files, e.wd, e.name, true);
+        }
+    }
+}
+
+void ScanWatcher::applyFile(int wd, const std::string& name) {
+    auto it = m_dirs.find(wd);
+    if (it == m_dirs.end()) {
+        return;
+    }
+    WatchedDir& dir = it->second;
+
+    // Like the scan, a symlink counts as the regular file it points to.
+    struct stat st {};
+    fs::path path = dir.path / name;
+    bool regular = ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+    auto size = static_cast<std::uint64_t>(st.st_size);
+
+    auto f = dir.files.find(name);
+    if (f != dir.files.end()) {
+        if (regular && f->second == size) {
+            return;
+        }
+        removeFileStats(m_result, name, f->second, m_options.categories);
+        if (!regular) {
+            dir.files.erase(f);
+            return;
+        }
+        f->second = size;
+    } else if (regular) {
+        dir.files.emplace(name, size);
+    } else {
+        return;
+    }
+    addFileStats(m_result, name, size, m_options.categories);
+}
+
+bool ScanWatcher::update(std::chrono::milliseconds timeout) {
+    pollfd p{m_fd, POLLIN, 0};
+    if (::poll(&p, 1, static_cast<int>(timeout.count())) <= 0) {
+        return false;
+    }
+
+    std::vector<DirEvent> dirEvents;
+    const auto begin = std::chrono::steady_clock::now();
+    while (readEvents(dirEvents)) {
+        auto left = kBatchMax - (std::chrono::steady_clock::now() - begin);
+        auto wait = std::min<std::chrono::steady_clock::duration>(kBatchQuiet, left);
+        if (wait <= std::chrono::steady_clock::duration::zero() ||
+            ::poll(&p, 1, static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(wait).count())) <= 0) {
+            break;
+        }
+    }
+
+    if (m_overflow) {
+        ++m_rescans;
+        rescan();
+        return true;
+    }
+
+    for (const DirEvent& e : dirEvents) {
+        applyDirEvent(e);
+    }
+    for (const auto& [wd, names] : m_dirty) {
+        for (const std::string& name : names) {
+            applyFile(wd, name);
+        }
+    }
+    m_dirty.clear();
+    return true;
+}
+
+#endif
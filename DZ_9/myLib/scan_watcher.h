@@ -0,0 +1,79 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "mylib.h"
+
+// Keeps the counters of a scan current from inotify events instead of rescanning: after one
+// initial scan every directory gets a watch, and creates, deletes, renames and writes are
+// applied to the totals, categories and histograms as they happen. Only changed names are
+// stat'ed again; a directory that appears is scanned on its own, one that disappears is
+// subtracted from what was recorded for it. If the kernel event queue overflows, the whole
+// tree is scanned again.
+//
+// Only the aggregate counters are maintained: `files`, `largest` and `usage` of result()
+// are left empty. Directories that cannot be watched (fs.inotify.max_user_watches) are left
+// out of the counters altogether, so they never drift. Files written through a directory
+// that was created a moment before its watch could be added are only seen once they change
+// again.
+class ScanWatcher {
+public:
+    ScanWatcher() = default;
+    ScanWatcher(const ScanWatcher&) = delete;
+    ScanWatcher& operator=(const ScanWatcher&) = delete;
+    ~ScanWatcher();
+
+    // Scans `root` with `options` (whose `categories` must outlive the watcher) and watches
+    // it. False if `root` is not a directory or inotify is unavailable.
+    bool start(const std::filesystem::path& root, const ScanOptions& options);
+
+    // Sleeps in poll() for up to `timeout` while nothing happens. Once an event arrives, more
+    // are gathered until the tree has been quiet for 50 ms, but for no longer than 500 ms, and
+    // then applied in one go. Returns true if the counters may have changed.
+    bool update(std::chrono::milliseconds timeout);
+
+    const ScanResult& result() const { return m_result; }
+    std::size_t watchedDirectories() const { return m_dirs.size(); }
+    std::uint64_t unwatchedDirectories() const { return m_unwatched; }
+    std::uint64_t rescans() const { return m_rescans; }
+
+private:
+    struct WatchedDir {
+        std::filesystem::path path;
+        int parent = -1;
+        std::unordered_map<std::string, std::uint64_t> files;
+        std::unordered_map<std::string, int> subdirs;
+    };
+
+    struct DirEvent {
+        int wd;
+        std::uint32_t mask;
+        std::string name;
+    };
+
+    bool rescan();
+    void import(const FileTable& table, int parent, const std::string& name, bool count);
+    void removeSubtree(int wd);
+    bool readEvents(std::vector<DirEvent>& dirEvents);
+    void applyDirEvent(const DirEvent& e);
+    void applyFile(int wd, const std::string& name);
+
+    int m_fd = -1;
+    std::filesystem::path m_root;
+    ScanOptions m_options;
+    ScanResult m_result;
+    std::unordered_map<int, WatchedDir> m_dirs;
+    std::unordered_map<int, std::unordered_set<std::string>> m_dirty;
+    bool m_overflow = false;
+    std::uint64_t m_unwatched = 0;
+    std::uint64_t m_rescans = 0;
+};
+
+#endif
@@ -0,0 +1,203 @@
+#include "uring_stat.h"
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// Everything the kernel touches for one in-flight request. The name is copied in so that a
+// request that cannot be waited for never reads caller memory that was freed or reused.
+struct SlotBuffer {
+    struct statx result;
+    char name[NAME_MAX + 1];
+};
+
+}  // namespace
+
+StatxRing::~StatxRing() {
+    if (m_sqes) ::munmap(m_sqes, m_sqesBytes);
+    if (m_cqRing && m_cqRing != m_sqRing) ::munmap(m_cqRing, m_cqRingBytes);
+    if (m_sqRing) ::munmap(m_sqRing, m_sqRingBytes);
+    if (m_fd >= 0) ::close(m_fd);
+}
+
+bool StatxRing::init(unsigned depth) {
+    io_uring_params p{};
+    long fd = ::syscall(__NR_io_uring_setup, depth, &p);
+    if (fd < 0) {
+        return false;
+    }
+    m_fd = static_cast<int>(fd);
+
+    m_sqRingBytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cqRingBytes = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        m_sqRingBytes = m_cqRingBytes = std::max(m_sqRingBytes, m_cqRingBytes);
+    }
+
+    m_sqRing = ::mmap(nullptr, m_sqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                      IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED) {
+        m_sqRing = nullptr;
+        return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        m_cqRing = m_sqRing;
+    } else {
+        m_cqRing = ::mmap(nullptr, m_cqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                          IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED) {
+            m_cqRing = nullptr;
+            return false;
+        }
+    }
+
+    m_sqesBytes = p.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = ::mmap(nullptr, m_sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                    IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED) {
+        m_sqes = nullptr;
+        return false;
+    }
+
+    auto* sq = static_cast<char*>(m_sqRing);
+    auto* cq = static_cast<char*>(m_cqRing);
+    m_sqHead = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    m_sqMask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    m_sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    m_cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    m_cqMask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    m_cqes = cq + p.cq_off.cqes;
+
+    m_depth = p.sq_entries;
+    m_slotBuffers.resize(m_depth * sizeof(SlotBuffer));
+    return true;
+}
+
+bool StatxRing::enter(unsigned& submit, unsigned wait) {
+    while (submit > 0 || wait > 0) {
+        long n = ::syscall(__NR_io_uring_enter, m_fd, submit, wait, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        submit -= static_cast<unsigned>(n);
+        wait = 0;
+    }
+    return true;
+}
+
+bool StatxRing::run(int dirfd, std::span<StatxRequest> requests) {
+    auto* sqes = static_cast<io_uring_sqe*>(m_sqes);
+    auto* cqes = static_cast<io_uring_cqe*>(m_cqes);
+    auto* buffers = reinterpret_cast<SlotBuffer*>(m_slotBuffers.data());
+
+    m_freeSlots.clear();
+    for (unsigned slot = m_depth; slot-- > 0;) {
+        m_freeSlots.push_back(slot);
+    }
+
+    bool supported = true;
+    std::size_t next = 0;
+    std::size_t done = 0;
+    std::size_t inFlight = 0;  // taken by the kernel, not completed yet
+    auto reap = [&] {
+        unsigned head = *m_cqHead;
+        unsigned ready = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+        for (; head != ready; ++head) {
+            const io_uring_cqe& cqe = cqes[head & m_cqMask];
+            auto slot = static_cast<unsigned>(cqe.user_data & 0xFFFFFFFFu);
+            StatxRequest& r = requests[static_cast<std::size_t>(cqe.user_data >> 32)];
+
+            if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) {
+                supported = false;
+            }
+            r.result = cqe.res < 0 ? cqe.res : 0;
+            if (cqe.res == 0) {
+                r.mode = buffers[slot].result.stx_mode;
+                r.size = buffers[slot].result.stx_size;
+            }
+
+            m_freeSlots.push_back(slot);
+            ++done;
+            --inFlight;
+        }
+        __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+    };
+
+    while (done < requests.size()) {
+        unsigned submit = 0;
+        unsigned tail = *m_sqTail;
+        while (next < requests.size() && !m_freeSlots.empty()) {
+            std::size_t length = std::strlen(requests[next].name);
+            if (length > NAME_MAX) {
+                requests[next++].result = -ENAMETOOLONG;
+                ++done;
+                continue;
+            }
+            unsigned slot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+            std::memcpy(buffers[slot].name, requests[next].name, length + 1);
+
+            unsigned index = tail & m_sqMask;
+            io_uring_sqe* sqe = &sqes[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = dirfd;
+            sqe->addr = reinterpret_cast<std::uint64_t>(buffers[slot].name);
+            sqe->len = STATX_TYPE | STATX_MODE | STATX_SIZE;
+            sqe->statx_flags = static_cast<std::uint32_t>(requests[next].flags);
+            sqe->off = reinterpret_cast<std::uint64_t>(&buffers[slot].result);
+            sqe->user_data = (static_cast<std::uint64_t>(next) << 32) | slot;
+            m_sqArray[index] = index;
+
+            ++tail;
+            ++next;
+            ++submit;
+        }
+        __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+        if (done == requests.size()) {
+            break;  // the rest was answered without the kernel; nothing to wait for
+        }
+
+        unsigned queued = submit;
+        bool entered = enter(submit, 1);
+        inFlight += queued - submit;
+        if (!entered) {
+            // Requests already taken still read and write m_slotBuffers, and closing the ring
+            // does not wait for them; they have to complete before returning. SQEs the kernel
+            // did not take are dropped with the ring.
+            reap();
+            while (inFlight > 0) {
+                unsigned none = 0;
+                if (!enter(none, 1)) {
+                    // Cannot wait: leave the buffers to the kernel rather than free them.
+                    new std::vector<unsigned char>(std::move(m_slotBuffers));
+                    break;
+                }
+                reap();
+            }
+            return false;
+        }
+        reap();
+    }
+
+    return supported;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// One statx call; `name` is relative to the directory fd handed to StatxRing::run().
+struct StatxRequest {
+    const char* name = nullptr;
+    int flags = 0;
+    int result = 0;  // 0 or -errno
+    std::uint32_t mode = 0;
+    std::uint64_t size = 0;
+};
+
+// Minimal io_uring instance on raw syscalls (no liburing dependency) that keeps up to `depth`
+// IORING_OP_STATX requests in flight. Not thread-safe; the walker keeps one per worker.
+class StatxRing {
+public:
+    StatxRing() = default;
+    StatxRing(const StatxRing&) = delete;
+    StatxRing& operator=(const StatxRing&) = delete;
+    ~StatxRing();
+
+    // False when io_uring cannot be used here (old kernel, seccomp, io_uring_disabled...).
+    bool init(unsigned depth);
+
+    // Fills result/mode/size of every request. Returns false if the ring itself failed or the
+    // kernel does not support statx through io_uring; the caller then stats synchronously.
+    bool run(int dirfd, std::span<StatxRequest> requests);
+
+private:
+    // `submit` is left with the number of SQEs the kernel did not take.
+    bool enter(unsigned& submit, unsigned wait);
+
+    int m_fd = -1;
+    unsigned m_depth = 0;
+
+    void* m_sqRing = nullptr;
+    std::size_t m_sqRingBytes = 0;
+    void* m_cqRing = nullptr;
+    std::size_t m_cqRingBytes = 0;
+    void* m_sqes = nullptr;
+    std::size_t m_sqesBytes = 0;
+
+    unsigned* m_sqHead = nullptr;
+    unsigned* m_sqTail = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned* m_sqArray = nullptr;
+    unsigned* m_cqHead = nullptr;
+    unsigned* m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    void* m_cqes = nullptr;
+
+    std::vector<unsigned char> m_slotBuffers;  // statx result and name per slot
+    std::vector<unsigned> m_freeSlots;
+};
+
+#endif